@@ -16,10 +16,14 @@
  * \code{.sh}
  * echo bad > /dev/chardev
  * \endcode
+ *
+ * Operation statistics are under /sys/kernel/chardev/stats; see
+ * modstats/modstats.c.
  */
 
 #include <linux/cdev.h>
 #include <linux/fs.h>
+#include <modstats.h>
 
 /* Function prototypes - these would normally go in a header. */
 static int device_open(struct inode *, struct file *);
@@ -46,6 +50,8 @@ static atomic_t already_open = ATOMIC_INIT(CDEV_NOT_USED);
 static char msg[BUF_LEN + 1];
 /* See <https://lwn.net/Articles/128644/>. */
 static struct class *cls;
+/* Our /sys/kernel/chardev/stats. */
+static struct modstats *stats;
 /* This structure holds the functions to be called when a process does
  * something to the device we created. Since a pointer to this structure
  * is kept in the devices table, it can't be local to init_module. NULL is
@@ -61,10 +67,14 @@ static struct file_operations chardev_fops = {
 
 static int __init chardev_init(void)
 {
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
 	major = register_chrdev(0, DEVICE_NAME, &chardev_fops);
 	if (major < 0) {
 		pr_alert("%s: Registering char device failed with %d\n",
 			 DEVICE_NAME, major);
+		modstats_unregister(stats);
 		return major;
 	}
 	pr_info("%s: I was assigned major number %d.\n", DEVICE_NAME, major);
@@ -81,6 +91,7 @@ static void __exit chardev_exit(void)
 	class_destroy(cls);
 	/* Unregister the device */
 	unregister_chrdev(major, DEVICE_NAME);
+	modstats_unregister(stats);
 	pr_info("%s: Exiting.\n", DEVICE_NAME);
 }
 
@@ -92,17 +103,24 @@ static void __exit chardev_exit(void)
 static int device_open(struct inode *inode, struct file *file)
 {
 	static int counter = 0;
+	u64 start = modstats_start();
+	int ret = 0;
 	if (atomic_cmpxchg(&already_open, CDEV_NOT_USED, CDEV_EXCLUSIVE_OPEN))
-		return -EBUSY;
-	sprintf(msg, "I already told you %d times Hello world!\n", counter++);
-	return 0;
+		ret = -EBUSY;
+	else
+		sprintf(msg, "I already told you %d times Hello world!\n",
+			counter++);
+	modstats_record(stats, MODSTATS_OPEN, start, ret);
+	return ret;
 }
 
 /* Called when a process closes the device file. */
 static int device_release(struct inode *inode, struct file *file)
 {
+	u64 start = modstats_start();
 	/* We're now ready for our next caller */
 	atomic_set(&already_open, CDEV_NOT_USED);
+	modstats_record(stats, MODSTATS_RELEASE, start, 0);
 	return 0;
 }
 
@@ -114,11 +132,13 @@ static ssize_t device_read(struct file *filp, /* see include/linux/fs.h */
 			   size_t length, /* length of the buffer */
 			   loff_t *offset)
 {
+	u64 start = modstats_start();
 	/* Number of bytes actually written to the buffer */
 	int bytes_read = 0;
 	const char *msg_ptr = msg;
 	if (msg_ptr[*offset] == '\0') { /* we are at the end of message */
 		*offset = 0; /* reset the offset */
+		modstats_record(stats, MODSTATS_READ, start, 0);
 		return 0; /* signify end of file */
 	}
 	msg_ptr += *offset;
@@ -138,6 +158,7 @@ static ssize_t device_read(struct file *filp, /* see include/linux/fs.h */
 		bytes_read++;
 	}
 	*offset += bytes_read;
+	modstats_record(stats, MODSTATS_READ, start, bytes_read);
 	/* Most read functions return the number of bytes put into the buffer. */
 	return bytes_read;
 }
@@ -146,7 +167,9 @@ static ssize_t device_read(struct file *filp, /* see include/linux/fs.h */
 static ssize_t device_write(struct file *filp, const char __user *buff,
 			    size_t len, loff_t *off)
 {
+	u64 start = modstats_start();
 	pr_alert("%s: Write operations are not supported.\n", DEVICE_NAME);
+	modstats_record(stats, MODSTATS_WRITE, start, -EINVAL);
 	return -EINVAL;
 }
 
@@ -0,0 +1,400 @@
+/* \file async.c
+ *
+ * The async mode of chardev2 (mode=async). A write() only queues its
+ * message and returns; workers run a transform over the queued messages,
+ * and read() returns the results, as a struct chardev2_result followed by
+ * the output, in the order in which they were completed.
+ *
+ * Each CPU has its own queue and one work item, on a per-CPU workqueue
+ * with max_active 1: there is at most one worker per CPU, and a writer
+ * only takes the lock of its own CPU's queue. A worker takes its whole
+ * queue at once and transforms it in batches of async_batch messages;
+ * each batch is published to readers with one lock and one wake-up.
+ * At most async_depth messages are queued, being transformed, or
+ * waiting for a reader; past that, writers wait, or get EAGAIN.
+ *
+ * The transform is chosen with the transform parameter:
+ * - copy returns the message itself;
+ * - crc32c returns its CRC32C, little-endian, from the crypto API;
+ * - lz4 returns it compressed with LZ4, from the crypto API.
+ */
+
+#include <chardev2_private.h>
+#include <crypto/hash.h>
+#include <linux/crypto.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+static char *transform = "copy";
+module_param(transform, charp, 0444);
+MODULE_PARM_DESC(transform, "Transform of async mode: copy, crc32c or lz4.");
+
+static unsigned int async_batch = 16;
+module_param(async_batch, uint, 0444);
+MODULE_PARM_DESC(async_batch, "Messages per batch of a worker (default: 16).");
+
+static unsigned int async_depth = 1024;
+module_param(async_depth, uint, 0444);
+MODULE_PARM_DESC(async_depth,
+		 "Messages in flight in async mode (default: 1024).");
+
+#define ASYNC_BATCH_MAX 64
+
+struct async_job {
+	struct list_head node;
+	struct chardev2_result result;
+	u64 ts; /* When it was published, from ktime_get_ns() */
+	u32 len;
+	u8 *out; /* In data, after the message */
+	u8 data[];
+};
+
+struct async_cpu {
+	spinlock_t lock;
+	struct list_head pending;
+	struct work_struct work;
+	void *ctx; /* Of the transform */
+};
+
+struct async_transform {
+	const char *name;
+	/* The most output for @len bytes of input */
+	size_t (*max_out)(size_t len);
+	/* Per worker state, if any */
+	void *(*ctx_alloc)(void);
+	void (*ctx_free)(void *ctx);
+	/* Fill in out, result.len and result.status of each job */
+	void (*run)(struct async_job **jobs, unsigned int n, void *ctx);
+};
+
+static const struct async_transform *xform;
+static struct workqueue_struct *async_wq;
+static DEFINE_PER_CPU(struct async_cpu, async_cpus);
+static atomic64_t async_seq;
+
+/* The jobs of all the queues, and the results not read yet. */
+static atomic_t nr_jobs;
+static DECLARE_WAIT_QUEUE_HEAD(space_wait);
+
+static LIST_HEAD(done_jobs);
+static DEFINE_SPINLOCK(done_lock);
+static DECLARE_WAIT_QUEUE_HEAD(done_wait);
+
+static size_t copy_max_out(size_t len)
+{
+	return len;
+}
+
+static void copy_run(struct async_job **jobs, unsigned int n, void *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		memcpy(jobs[i]->out, jobs[i]->data, jobs[i]->len);
+		jobs[i]->result.len = jobs[i]->len;
+		jobs[i]->result.status = 0;
+	}
+}
+
+static size_t crc32c_max_out(size_t len)
+{
+	return sizeof(u32);
+}
+
+static void *crc32c_ctx_alloc(void)
+{
+	return crypto_alloc_shash("crc32c", 0, 0);
+}
+
+static void crc32c_ctx_free(void *ctx)
+{
+	crypto_free_shash(ctx);
+}
+
+static void crc32c_run(struct async_job **jobs, unsigned int n, void *ctx)
+{
+	SHASH_DESC_ON_STACK(desc, ctx);
+	unsigned int i;
+
+	desc->tfm = ctx;
+	for (i = 0; i < n; i++) {
+		jobs[i]->result.status = crypto_shash_digest(
+			desc, jobs[i]->data, jobs[i]->len, jobs[i]->out);
+		jobs[i]->result.len = sizeof(u32);
+	}
+}
+
+/* LZ4_COMPRESSBOUND(), without pulling in lz4.h. */
+static size_t lz4_max_out(size_t len)
+{
+	return len + len / 255 + 16;
+}
+
+static void *lz4_ctx_alloc(void)
+{
+	return crypto_alloc_comp("lz4", 0, 0);
+}
+
+static void lz4_ctx_free(void *ctx)
+{
+	crypto_free_comp(ctx);
+}
+
+static void lz4_run(struct async_job **jobs, unsigned int n, void *ctx)
+{
+	unsigned int i, dlen;
+
+	for (i = 0; i < n; i++) {
+		dlen = lz4_max_out(jobs[i]->len);
+		jobs[i]->result.status = crypto_comp_compress(
+			ctx, jobs[i]->data, jobs[i]->len, jobs[i]->out, &dlen);
+		jobs[i]->result.len = jobs[i]->result.status ? 0 : dlen;
+	}
+}
+
+static const struct async_transform transforms[] = {
+	{
+		.name = "copy",
+		.max_out = copy_max_out,
+		.run = copy_run,
+	},
+	{
+		.name = "crc32c",
+		.max_out = crc32c_max_out,
+		.ctx_alloc = crc32c_ctx_alloc,
+		.ctx_free = crc32c_ctx_free,
+		.run = crc32c_run,
+	},
+	{
+		.name = "lz4",
+		.max_out = lz4_max_out,
+		.ctx_alloc = lz4_ctx_alloc,
+		.ctx_free = lz4_ctx_free,
+		.run = lz4_run,
+	},
+};
+
+static void async_work(struct work_struct *work)
+{
+	struct async_cpu *ac = container_of(work, struct async_cpu, work);
+	struct async_job *batch[ASYNC_BATCH_MAX], *job, *tmp;
+	LIST_HEAD(jobs);
+	LIST_HEAD(done);
+	unsigned int i, n;
+	u64 ts;
+
+	spin_lock(&ac->lock);
+	list_splice_init(&ac->pending, &jobs);
+	spin_unlock(&ac->lock);
+
+	while (!list_empty(&jobs)) {
+		n = 0;
+		list_for_each_entry_safe(job, tmp, &jobs, node) {
+			if (n == async_batch)
+				break;
+			batch[n++] = job;
+			list_move_tail(&job->node, &done);
+		}
+		xform->run(batch, n, ac->ctx);
+
+		ts = ktime_get_ns();
+		for (i = 0; i < n; i++)
+			batch[i]->ts = ts;
+		spin_lock(&done_lock);
+		list_splice_tail_init(&done, &done_jobs);
+		spin_unlock(&done_lock);
+		wake_up_interruptible(&done_wait);
+		cond_resched();
+	}
+}
+
+static bool reserve_job(void)
+{
+	return atomic_add_unless(&nr_jobs, 1, async_depth);
+}
+
+static void release_job(struct async_job *job)
+{
+	kfree(job);
+	atomic_dec(&nr_jobs);
+	wake_up_interruptible(&space_wait);
+}
+
+/* Queue the message on the queue of this CPU, and return. */
+ssize_t async_write(struct file *file, const char __user *buf, size_t len)
+{
+	struct async_cpu *ac;
+	struct async_job *job;
+	int cpu;
+
+	len = min_t(size_t, len, ASYNC_MSG_MAX);
+	if (!reserve_job()) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(space_wait, reserve_job()))
+			return -ERESTARTSYS;
+	}
+
+	job = kmalloc(struct_size(job, data, len + xform->max_out(len)),
+		      GFP_KERNEL);
+	if (!job) {
+		atomic_dec(&nr_jobs);
+		return -ENOMEM;
+	}
+	if (copy_from_user(job->data, buf, len)) {
+		release_job(job);
+		return -EFAULT;
+	}
+	job->len = len;
+	job->out = job->data + len;
+	job->result.seq = atomic64_inc_return(&async_seq) - 1;
+
+	cpu = get_cpu();
+	ac = per_cpu_ptr(&async_cpus, cpu);
+	spin_lock(&ac->lock);
+	list_add_tail(&job->node, &ac->pending);
+	spin_unlock(&ac->lock);
+	/* Does nothing if the work is already queued. */
+	queue_work_on(cpu, async_wq, &ac->work);
+	put_cpu();
+	return len;
+}
+
+static bool done_ready(void)
+{
+	return !list_empty_careful(&done_jobs);
+}
+
+static bool done_spin_ready(void *arg)
+{
+	return done_ready();
+}
+
+/* Return the oldest result, whole; @len must be large enough for it. */
+ssize_t async_read(struct chardev2_file *cf, struct file *file,
+		   char __user *buf, size_t len)
+{
+	struct async_job *job;
+	bool waited = false, spun = false;
+	ssize_t size;
+
+	for (;;) {
+		spin_lock(&done_lock);
+		job = list_first_entry_or_null(&done_jobs, struct async_job,
+					       node);
+		if (job) {
+			size = sizeof(job->result) + job->result.len;
+			if (len < size) {
+				spin_unlock(&done_lock);
+				return -EINVAL;
+			}
+			list_del(&job->node);
+		}
+		spin_unlock(&done_lock);
+		if (job)
+			break;
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		/* Another reader may take the result we spun for; then we
+		 * spin, or sleep, again.
+		 */
+		waited = true;
+		spun = busy_poll(cf, done_spin_ready, NULL);
+		if (!spun && wait_event_interruptible(done_wait, done_ready()))
+			return -ERESTARTSYS;
+	}
+
+	if (waited)
+		busy_poll_record(spun, job->ts);
+
+	if (copy_to_user(buf, &job->result, sizeof(job->result)) ||
+	    copy_to_user(buf + sizeof(job->result), job->out,
+			 job->result.len))
+		size = -EFAULT;
+	release_job(job);
+	return size;
+}
+
+__poll_t async_poll(struct file *file, poll_table *wait)
+{
+	__poll_t mask = 0;
+
+	poll_wait(file, &done_wait, wait);
+	poll_wait(file, &space_wait, wait);
+	if (done_ready())
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (atomic_read(&nr_jobs) < async_depth)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	return mask;
+}
+
+int async_init(void)
+{
+	unsigned int i;
+	int cpu;
+
+	for (i = 0; i < ARRAY_SIZE(transforms); i++)
+		if (!strcmp(transform, transforms[i].name))
+			xform = &transforms[i];
+	if (!xform || !async_depth)
+		return -EINVAL;
+	async_batch = clamp(async_batch, 1U, (unsigned int)ASYNC_BATCH_MAX);
+
+	/* Per-CPU, and at most one of our work items per CPU at a time. */
+	async_wq = alloc_workqueue("chardev2_async", 0, 1);
+	if (!async_wq)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct async_cpu *ac = per_cpu_ptr(&async_cpus, cpu);
+
+		spin_lock_init(&ac->lock);
+		INIT_LIST_HEAD(&ac->pending);
+		INIT_WORK(&ac->work, async_work);
+		if (xform->ctx_alloc) {
+			ac->ctx = xform->ctx_alloc();
+			if (IS_ERR(ac->ctx)) {
+				int ret = PTR_ERR(ac->ctx);
+
+				pr_alert("%s: %s is not available: %d\n",
+					 DEVICE_NAME, xform->name, ret);
+				ac->ctx = NULL;
+				async_exit();
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+/* The device is gone, so no more jobs arrive; destroying the workqueue
+ * runs those which are queued.
+ */
+void async_exit(void)
+{
+	struct async_job *job, *tmp;
+	int cpu;
+
+	if (!async_wq)
+		return;
+	destroy_workqueue(async_wq);
+	async_wq = NULL;
+	list_for_each_entry_safe(job, tmp, &done_jobs, node)
+		kfree(job);
+	INIT_LIST_HEAD(&done_jobs);
+	for_each_possible_cpu(cpu) {
+		struct async_cpu *ac = per_cpu_ptr(&async_cpus, cpu);
+
+		if (ac->ctx)
+			xform->ctx_free(ac->ctx);
+		ac->ctx = NULL;
+	}
+}
@@ -0,0 +1,145 @@
+/* \file busypoll.c
+ *
+ * Busy-polling reads, for mode=log and mode=async. A read() with nothing
+ * to return normally sleeps on a wait queue; the writer's wake-up then
+ * has to schedule the reader back in, possibly on an idle CPU, which
+ * costs microseconds. Like SO_BUSY_POLL for sockets, a file can instead
+ * ask, with IOCTL_SET_BUSY_POLL, to spin for a number of microseconds,
+ * checking for data, before it goes to sleep. That burns a CPU to save
+ * the wake-up, so it is off by default, and capped by busy_poll_max_us.
+ *
+ * A read() which had to wait records, when it gets its data, how long ago
+ * that data was published, in one of two histograms: "spin" if it was
+ * found while spinning, "sleep" if the reader slept. They are in
+ *
+ *     /sys/kernel/chardev2/stats/wakeup_latency
+ *
+ * as "<spin|sleep> <lower bound in ns> <count>" lines, like the latency
+ * file next to it, and writing anything to it clears them.
+ */
+
+#include <chardev2_private.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/sched.h> /* For need_resched() */
+#include <linux/sched/clock.h> /* For local_clock() */
+#include <linux/sched/signal.h> /* For signal_pending() */
+#include <linux/sysfs.h>
+#include <modstats.h>
+
+static unsigned int busy_poll_max_us = 1000;
+module_param(busy_poll_max_us, uint, 0644);
+MODULE_PARM_DESC(busy_poll_max_us,
+		 "Longest busy-poll a file may ask for (default: 1000).");
+
+enum { WAKEUP_SLEEP, WAKEUP_SPIN, NR_WAKEUPS };
+
+static const char *const wakeup_names[NR_WAKEUPS] = {
+	[WAKEUP_SLEEP] = "sleep",
+	[WAKEUP_SPIN] = "spin",
+};
+
+struct wakeup_hist {
+	u64 count[NR_WAKEUPS][MODSTATS_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct wakeup_hist, wakeup_hists);
+
+int busy_poll_set(struct chardev2_file *cf, u32 us)
+{
+	if (us > READ_ONCE(busy_poll_max_us))
+		return -EINVAL;
+	WRITE_ONCE(cf->busy_poll_us, us);
+	return 0;
+}
+
+/* Spin until ready(@arg), for the busy-poll time of @cf at most. We give
+ * up early when the scheduler wants the CPU, or on a signal; the caller
+ * then sleeps as usual. Returns whether ready(@arg) became true.
+ *
+ * ready() is called without any lock, as often as the CPU allows, so it
+ * should only read a shared word; the caller checks again under its lock.
+ */
+bool busy_poll(struct chardev2_file *cf, bool (*ready)(void *arg), void *arg)
+{
+	u32 us = READ_ONCE(cf->busy_poll_us);
+	u64 end;
+
+	if (!us)
+		return false;
+	/* We may migrate while spinning, which only makes the limit fuzzy. */
+	end = local_clock() + (u64)us * NSEC_PER_USEC;
+	do {
+		if (ready(arg))
+			return true;
+		if (need_resched() || signal_pending(current))
+			break;
+		cpu_relax();
+	} while (local_clock() < end);
+	return ready(arg);
+}
+
+/* Account for data published at @ts, from ktime_get_ns(), which a reader
+ * waited for.
+ */
+void busy_poll_record(bool spun, u64 ts)
+{
+	this_cpu_inc(wakeup_hists.count[spun ? WAKEUP_SPIN : WAKEUP_SLEEP]
+				       [modstats_bucket(ktime_get_ns() - ts)]);
+}
+
+static ssize_t wakeup_latency_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int i, bucket, cpu;
+
+	for (i = 0; i < NR_WAKEUPS; i++) {
+		for (bucket = 0; bucket < MODSTATS_BUCKETS; bucket++) {
+			u64 count = 0;
+
+			for_each_possible_cpu(cpu)
+				count += per_cpu(wakeup_hists, cpu)
+						 .count[i][bucket];
+			if (!count)
+				continue;
+			/* Stop rather than overflow the page. */
+			if (len + 64 > PAGE_SIZE)
+				return len;
+			len += sprintf(buf + len, "%s %llu %llu\n",
+				       wakeup_names[i],
+				       modstats_bucket_min(bucket), count);
+		}
+	}
+	return len;
+}
+
+/* Updates racing with the reset may survive it. */
+static ssize_t wakeup_latency_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&wakeup_hists, cpu), 0,
+		       sizeof(struct wakeup_hist));
+	return count;
+}
+
+static struct kobj_attribute wakeup_latency_attribute =
+	__ATTR_RW(wakeup_latency);
+
+/* Add wakeup_latency to the stats directory of @stats. */
+int busy_poll_init(struct modstats *stats)
+{
+	return sysfs_add_file_to_group(&stats->kobj,
+				       &wakeup_latency_attribute.attr, "stats");
+}
+
+void busy_poll_exit(struct modstats *stats)
+{
+	sysfs_remove_file_from_group(&stats->kobj,
+				     &wakeup_latency_attribute.attr, "stats");
+}
@@ -0,0 +1,422 @@
+/* \file chardev2_main.c
+ *
+ * Create an input/output character device.
+ *
+ * Operation statistics are under /sys/kernel/chardev2/stats. Since
+ * IOCTL_SET_MSG and IOCTL_GET_MSG are implemented with message_write()
+ * and message_read(), they also count as a write or a read.
+ *
+ * With mode=log, read() and write() go to a shared log instead of the
+ * message, and every open file reads all of it; see log.c. With
+ * mode=async, written messages are transformed by workers, and read()
+ * returns the results; see async.c. With mode=numa, the message is
+ * replicated on every node, and read from the local replica; see numa.c.
+ * The ioctls still work on the message, including IOCTL_HASH_MSG, which
+ * hashes it; see hash.c. IOCTL_SET_BUSY_POLL makes the reads of a file
+ * spin before they sleep, in log and async modes; see busypoll.c.
+ */
+
+#include <chardev2_private.h>
+#include <linux/cdev.h>
+#include <linux/fs.h>
+#include <linux/kernel.h> /* For u64_to_user_ptr() */
+#include <linux/moduleparam.h>
+#include <linux/poll.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <modstats.h>
+
+static char *mode = "message";
+module_param(mode, charp, 0444);
+MODULE_PARM_DESC(mode,
+		 "What read() and write() use: message, log, async or numa.");
+
+enum chardev2_mode chardev2_mode;
+
+static atomic_t already_open = ATOMIC_INIT(CDEV_NOT_USED);
+static char message[BUF_LEN + 1];
+/* Serializes the writes of the message with its hashing. Every write
+ * makes a new version, which tells when a cached digest is stale.
+ */
+static DEFINE_MUTEX(message_lock);
+static u64 message_version;
+/* Lets message_read() copy the message without message_lock. */
+static seqcount_t message_seq = SEQCNT_ZERO(message_seq);
+static struct class *cls;
+static struct modstats *stats;
+
+static int device_open(struct inode *inode, struct file *file)
+{
+	u64 start = modstats_start();
+	struct chardev2_file *cf;
+	int ret = 0;
+	pr_info("%s: device_open(%p,%p)\n", DEVICE_NAME, inode, file);
+	/* Increment the reference count of a module. See
+           <https://lwn.net/Articles/22197/> */
+	if (!try_module_get(THIS_MODULE)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	cf = kzalloc(sizeof(*cf), GFP_KERNEL);
+	if (!cf) {
+		module_put(THIS_MODULE);
+		ret = -ENOMEM;
+		goto out;
+	}
+	mutex_init(&cf->lock);
+	if (chardev2_mode == CHARDEV2_MODE_LOG)
+		log_open(cf);
+	file->private_data = cf;
+out:
+	modstats_record(stats, MODSTATS_OPEN, start, ret);
+	return ret;
+}
+
+static int device_release(struct inode *inode, struct file *file)
+{
+	u64 start = modstats_start();
+	pr_info("%s: device_release(%p,%p)\n", DEVICE_NAME, inode, file);
+	kfree(file->private_data);
+	/* Decrement the reference count of a module. */
+	module_put(THIS_MODULE);
+	modstats_record(stats, MODSTATS_RELEASE, start, 0);
+	return 0;
+}
+
+/* Copy the message at @data, BUF_LEN + 1 bytes whose writes are in
+ * @seq, to the buffer of a reader which got to @offset. The reads of
+ * mode=message and of mode=numa both go through here, so that they only
+ * differ in where the message is.
+ */
+ssize_t message_copy_to_user(const char *data, seqcount_t *seq,
+			     char __user *buffer, size_t length,
+			     loff_t *offset)
+{
+	char snapshot[BUF_LEN + 1];
+	unsigned int s;
+	size_t n;
+
+	do {
+		s = read_seqcount_begin(seq);
+		memcpy(snapshot, data, sizeof(snapshot));
+	} while (read_seqcount_retry(seq, s));
+
+	if (*offset < 0 || *offset >= BUF_LEN || !snapshot[*offset]) {
+		*offset = 0; /* we are at the end of message */
+		return 0; /* signify end of file */
+	}
+	n = min(length, strnlen(snapshot + *offset, BUF_LEN - *offset));
+	/* Because the buffer is in the user data segment, not the kernel
+	 * data segment, assignment would not work. Instead, we have to use
+	 * copy_to_user, which copies data from the kernel data segment to
+	 * the user data segment.
+	 */
+	if (copy_to_user(buffer, snapshot + *offset, n))
+		return -EFAULT;
+	*offset += n;
+	/* Read functions are supposed to return the number of bytes actually
+	 * inserted into the buffer.
+	 */
+	return n;
+}
+
+static ssize_t message_read(char __user *buffer, /* buffer to be filled */
+			    size_t length, /* length of the buffer */
+			    loff_t *offset)
+{
+	u64 start = modstats_start();
+	ssize_t ret;
+
+	ret = message_copy_to_user(message, &message_seq, buffer, length,
+				   offset);
+	pr_debug("%s: Read %zd bytes\n", DEVICE_NAME, ret);
+	modstats_record(stats, MODSTATS_READ, start, ret);
+	return ret;
+}
+
+static ssize_t message_write(const char __user *buffer, size_t length)
+{
+	u64 start = modstats_start();
+	char data[BUF_LEN];
+	int i;
+	pr_debug("%s: message_write(%p,%ld)", DEVICE_NAME, buffer, length);
+	/* Readers spin while the message changes, so copy it in first: a
+	 * copy from userspace may sleep on a page fault.
+	 */
+	for (i = 0; i < length && i < BUF_LEN; i++)
+		get_user(data[i], buffer + i);
+	mutex_lock(&message_lock);
+	preempt_disable();
+	write_seqcount_begin(&message_seq);
+	memcpy(message, data, i);
+	write_seqcount_end(&message_seq);
+	preempt_enable();
+	message_version++;
+	if (chardev2_mode == CHARDEV2_MODE_NUMA)
+		numa_publish(message);
+	mutex_unlock(&message_lock);
+	modstats_record(stats, MODSTATS_WRITE, start, i);
+	/* Again, return the number of input characters used. */
+	return i;
+}
+
+/* IOCTL_HASH_MSG and IOCTL_HASH_BUF; see hash.c. */
+static long device_hash(unsigned int ioctl_num,
+			struct chardev2_digest __user *arg)
+{
+	struct chardev2_digest req;
+	long ret;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+	if (ioctl_num == IOCTL_HASH_MSG) {
+		mutex_lock(&message_lock);
+		req.version = message_version;
+		ret = hash_message(req.algo, message, strnlen(message, BUF_LEN),
+				   req.version, &req.digest);
+		mutex_unlock(&message_lock);
+	} else {
+		ret = hash_user(req.algo, u64_to_user_ptr(req.buf), req.len,
+				&req.digest);
+	}
+	if (!ret && copy_to_user(arg, &req, sizeof(req)))
+		ret = -EFAULT;
+	return ret;
+}
+
+/* IOCTL_SET_BUSY_POLL and IOCTL_GET_BUSY_POLL only touch the caller's
+ * own file, so they need not wait for the ioctls of other files.
+ */
+static long device_busy_poll(struct file *file, unsigned int ioctl_num,
+			     u32 __user *arg)
+{
+	struct chardev2_file *cf = file->private_data;
+	u32 us;
+
+	if (ioctl_num == IOCTL_GET_BUSY_POLL)
+		return put_user(READ_ONCE(cf->busy_poll_us), arg);
+	if (get_user(us, arg))
+		return -EFAULT;
+	return busy_poll_set(cf, us);
+}
+
+/* This function is called whenever a process tries to do an ioctl on our
+ * device file. We get two extra parameters (additional to the inode and file
+ * structures, which all device functions get): the number of the ioctl called
+ * and the parameter given to the ioctl function.
+ *
+ * If the ioctl is write or read/write (meaning output is returned to the
+ * calling process), the ioctl call returns the output of this function.
+ */
+static long
+device_ioctl(struct file *file, /* ditto */
+	     unsigned int ioctl_num, /* number and param for ioctl */
+	     unsigned long ioctl_param)
+{
+	u64 start = modstats_start();
+	int i;
+	long ret = 0;
+	if (ioctl_num == IOCTL_SET_BUSY_POLL ||
+	    ioctl_num == IOCTL_GET_BUSY_POLL) {
+		ret = device_busy_poll(file, ioctl_num,
+				       (u32 __user *)ioctl_param);
+		modstats_record(stats, MODSTATS_IOCTL, start, ret);
+		return ret;
+	}
+	/* We don't want to talk to two processes at the same time. */
+	if (atomic_cmpxchg(&already_open, CDEV_NOT_USED, CDEV_EXCLUSIVE_OPEN)) {
+		modstats_record(stats, MODSTATS_IOCTL, start, -EBUSY);
+		return -EBUSY;
+	}
+	/* Switch according to the ioctl called */
+	switch (ioctl_num) {
+	case IOCTL_SET_MSG: {
+		/* Receive a pointer to a message (in user space) and set that to
+                 * be the device's message. Get the parameter given to ioctl by
+                 * the process.
+                 */
+		char __user *tmp = (char __user *)ioctl_param;
+		char ch;
+		/* Find the length of the message */
+		get_user(ch, tmp);
+		for (i = 0; ch && i < BUF_LEN; i++, tmp++)
+			get_user(ch, tmp);
+		message_write((char __user *)ioctl_param, i);
+		break;
+	}
+	case IOCTL_GET_MSG: {
+		loff_t offset = 0;
+		/* Give the current message to the calling process - the parameter
+                 * we got is a pointer, fill it.
+                 */
+		i = message_read((char __user *)ioctl_param, 99, &offset);
+		/* Put a zero at the end of the buffer, so it will be properly
+                 * terminated.
+                 */
+		if (i >= 0)
+			put_user('\0', (char __user *)ioctl_param + i);
+		else
+			ret = i;
+		break;
+	}
+	case IOCTL_GET_NTH_BYTE:
+		/* This ioctl is both input (ioctl_param) and output (the return
+                 * value of this function).
+                 */
+		ret = (long)message[ioctl_param];
+		break;
+	case IOCTL_HASH_MSG:
+	case IOCTL_HASH_BUF:
+		ret = device_hash(ioctl_num,
+				  (struct chardev2_digest __user *)ioctl_param);
+		break;
+	}
+	/* We're now ready for our next caller */
+	atomic_set(&already_open, CDEV_NOT_USED);
+	modstats_record(stats, MODSTATS_IOCTL, start, ret);
+	return ret;
+}
+
+static ssize_t device_read(struct file *file, /* see include/linux/fs.h */
+			   char __user *buffer, size_t length, loff_t *offset)
+{
+	u64 start;
+	ssize_t ret;
+
+	if (chardev2_mode == CHARDEV2_MODE_MESSAGE)
+		return message_read(buffer, length, offset);
+	start = modstats_start();
+	if (chardev2_mode == CHARDEV2_MODE_LOG)
+		ret = log_read(file->private_data, file, buffer, length);
+	else if (chardev2_mode == CHARDEV2_MODE_NUMA)
+		ret = numa_read(buffer, length, offset);
+	else
+		ret = async_read(file->private_data, file, buffer, length);
+	modstats_record(stats, MODSTATS_READ, start, ret);
+	return ret;
+}
+
+static ssize_t device_write(struct file *file, const char __user *buffer,
+			    size_t length, loff_t *offset)
+{
+	u64 start;
+	ssize_t ret;
+
+	if (chardev2_mode == CHARDEV2_MODE_MESSAGE ||
+	    chardev2_mode == CHARDEV2_MODE_NUMA)
+		return message_write(buffer, length);
+	start = modstats_start();
+	if (chardev2_mode == CHARDEV2_MODE_LOG)
+		ret = log_write(buffer, length);
+	else
+		ret = async_write(file, buffer, length);
+	modstats_record(stats, MODSTATS_WRITE, start, ret);
+	return ret;
+}
+
+static __poll_t device_poll(struct file *file, poll_table *wait)
+{
+	u64 start = modstats_start();
+	__poll_t mask;
+
+	switch (chardev2_mode) {
+	case CHARDEV2_MODE_LOG:
+		mask = log_poll(file->private_data, file, wait);
+		break;
+	case CHARDEV2_MODE_ASYNC:
+		mask = async_poll(file, wait);
+		break;
+	default:
+		mask = EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+	}
+	modstats_record(stats, MODSTATS_POLL, start, 0);
+	return mask;
+}
+
+static loff_t device_llseek(struct file *file, loff_t offset, int whence)
+{
+	if (chardev2_mode == CHARDEV2_MODE_LOG)
+		return log_llseek(file->private_data, offset, whence);
+	return -ESPIPE;
+}
+
+static struct file_operations fops = {
+	.read = device_read,
+	.write = device_write,
+	.poll = device_poll,
+	.llseek = device_llseek,
+	.unlocked_ioctl = device_ioctl,
+	.open = device_open,
+	.release = device_release, /* a.k.a. close */
+};
+
+static int __init chardev2_init(void)
+{
+	int ret_val = 0;
+	if (!strcmp(mode, "log"))
+		chardev2_mode = CHARDEV2_MODE_LOG;
+	else if (!strcmp(mode, "async"))
+		chardev2_mode = CHARDEV2_MODE_ASYNC;
+	else if (!strcmp(mode, "numa"))
+		chardev2_mode = CHARDEV2_MODE_NUMA;
+	else if (strcmp(mode, "message"))
+		return -EINVAL;
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
+	ret_val = busy_poll_init(stats);
+	if (ret_val) {
+		modstats_unregister(stats);
+		return ret_val;
+	}
+	if (chardev2_mode == CHARDEV2_MODE_LOG)
+		ret_val = log_init();
+	else if (chardev2_mode == CHARDEV2_MODE_ASYNC)
+		ret_val = async_init();
+	else if (chardev2_mode == CHARDEV2_MODE_NUMA)
+		ret_val = numa_init();
+	if (ret_val) {
+		busy_poll_exit(stats);
+		modstats_unregister(stats);
+		return ret_val;
+	}
+	hash_init();
+	/* Try to register the character device */
+	ret_val = register_chrdev(MAJOR_NUM, DEVICE_NAME, &fops);
+	if (ret_val < 0) {
+		pr_alert(
+			"%s: Registering the character device failed with %d\n",
+			DEVICE_NAME, ret_val);
+		log_exit();
+		async_exit();
+		numa_exit();
+		hash_exit();
+		busy_poll_exit(stats);
+		modstats_unregister(stats);
+		return ret_val;
+	}
+	cls = class_create(THIS_MODULE, DEVICE_NAME);
+	device_create(cls, NULL, MKDEV(MAJOR_NUM, 0), NULL, DEVICE_NAME);
+	pr_info("%s: Device created on /dev/%s.\n", DEVICE_NAME, DEVICE_NAME);
+	return 0;
+}
+
+static void __exit chardev2_exit(void)
+{
+	device_destroy(cls, MKDEV(MAJOR_NUM, 0));
+	class_destroy(cls);
+	unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
+	log_exit();
+	async_exit();
+	numa_exit();
+	hash_exit();
+	busy_poll_exit(stats);
+	modstats_unregister(stats);
+	pr_info("%s: Exiting.\n", DEVICE_NAME);
+}
+
+module_init(chardev2_init);
+module_exit(chardev2_exit);
+
+MODULE_LICENSE("GPL");
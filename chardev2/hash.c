@@ -0,0 +1,169 @@
+/* \file hash.c
+ *
+ * IOCTL_HASH_MSG and IOCTL_HASH_BUF: CRC32C and xxHash64 of the message,
+ * or of a user buffer, computed in the kernel.
+ *
+ * The hashes come from the crypto API (crypto_alloc_shash()), which
+ * picks the fastest implementation the CPU has, e.g. crc32c-intel with
+ * the SSE4.2 crc32 instruction, rather than the generic C. One tfm per
+ * algorithm serves all callers, each with its own descriptor on the
+ * stack.
+ *
+ * The digest of the message is kept, with the version of the message it
+ * is for, so that asking again until the next write costs no hashing.
+ */
+
+#include <chardev2_private.h>
+#include <crypto/hash.h>
+#include <linux/err.h>
+#include <linux/sched/signal.h> /* For fatal_signal_pending() */
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+
+#define NR_HASHES 2
+#define HASH_CHUNK PAGE_SIZE
+
+static const char *const hash_names[NR_HASHES] = {
+	[CHARDEV2_HASH_CRC32C] = "crc32c",
+	[CHARDEV2_HASH_XXHASH64] = "xxhash64",
+};
+
+/* NULL if the kernel lacks the algorithm. */
+static struct crypto_shash *tfms[NR_HASHES];
+
+static struct {
+	bool valid;
+	u64 version;
+	u64 digest;
+} cache[NR_HASHES];
+static DEFINE_SPINLOCK(cache_lock);
+
+static int check_algo(u32 algo)
+{
+	if (algo >= NR_HASHES)
+		return -EINVAL;
+	return tfms[algo] ? 0 : -EOPNOTSUPP;
+}
+
+/* The shash outputs are little-endian: the CRC32C is already inverted,
+ * as usual, and the xxHash64 is the plain value.
+ */
+static u64 to_digest(u32 algo, const u8 *out)
+{
+	if (algo == CHARDEV2_HASH_CRC32C)
+		return get_unaligned_le32(out);
+	return get_unaligned_le64(out);
+}
+
+int hash_message(u32 algo, const char *msg, size_t len, u64 version,
+		 u64 *digest)
+{
+	u8 out[sizeof(u64)];
+	bool hit;
+	int ret;
+
+	ret = check_algo(algo);
+	if (ret)
+		return ret;
+
+	spin_lock(&cache_lock);
+	hit = cache[algo].valid && cache[algo].version == version;
+	if (hit)
+		*digest = cache[algo].digest;
+	spin_unlock(&cache_lock);
+	if (hit)
+		return 0;
+
+	{
+		SHASH_DESC_ON_STACK(desc, tfms[algo]);
+
+		desc->tfm = tfms[algo];
+		ret = crypto_shash_digest(desc, msg, len, out);
+	}
+	if (ret)
+		return ret;
+	*digest = to_digest(algo, out);
+
+	spin_lock(&cache_lock);
+	cache[algo].valid = true;
+	cache[algo].version = version;
+	cache[algo].digest = *digest;
+	spin_unlock(&cache_lock);
+	return 0;
+}
+
+/* Hash @len bytes at @buf, HASH_CHUNK at a time. */
+int hash_user(u32 algo, const void __user *buf, u64 len, u64 *digest)
+{
+	u8 out[sizeof(u64)];
+	size_t n;
+	void *chunk;
+	int ret;
+
+	ret = check_algo(algo);
+	if (ret)
+		return ret;
+	chunk = kmalloc(HASH_CHUNK, GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
+
+	{
+		SHASH_DESC_ON_STACK(desc, tfms[algo]);
+
+		desc->tfm = tfms[algo];
+		ret = crypto_shash_init(desc);
+		while (!ret && len) {
+			n = min_t(u64, len, HASH_CHUNK);
+			if (copy_from_user(chunk, buf, n)) {
+				ret = -EFAULT;
+				break;
+			}
+			ret = crypto_shash_update(desc, chunk, n);
+			buf += n;
+			len -= n;
+			if (fatal_signal_pending(current))
+				ret = -EINTR;
+			cond_resched();
+		}
+		if (!ret)
+			ret = crypto_shash_final(desc, out);
+		shash_desc_zero(desc);
+	}
+	kfree(chunk);
+	if (!ret)
+		*digest = to_digest(algo, out);
+	return ret;
+}
+
+/* A missing algorithm only makes its ioctls fail. */
+void hash_init(void)
+{
+	int i;
+
+	for (i = 0; i < NR_HASHES; i++) {
+		tfms[i] = crypto_alloc_shash(hash_names[i], 0, 0);
+		if (IS_ERR(tfms[i])) {
+			pr_info("%s: %s is not available: %ld\n", DEVICE_NAME,
+				hash_names[i], PTR_ERR(tfms[i]));
+			tfms[i] = NULL;
+			continue;
+		}
+		pr_info("%s: %s is %s\n", DEVICE_NAME, hash_names[i],
+			crypto_shash_driver_name(tfms[i]));
+	}
+}
+
+void hash_exit(void)
+{
+	int i;
+
+	for (i = 0; i < NR_HASHES; i++)
+		crypto_free_shash(tfms[i]);
+}
@@ -11,6 +11,7 @@
 #define CHARDEV2_H_
 
 #include <linux/ioctl.h>
+#include <linux/types.h>
 
 /* The major device number. We can not rely on dynamic registration
  * any more, because ioctls need to know it.
@@ -41,6 +42,46 @@
  * a number, n, and returns message[n].
  */
 #define IOCTL_GET_NTH_BYTE _IOWR(MAJOR_NUM, 2, int)
+/* Hash the message, or a buffer of the caller, with the algorithm
+ * CHARDEV2_HASH_*, in the kernel: the digest of the message is cached
+ * until the message changes, so it costs nothing to ask again.
+ *
+ * For IOCTL_HASH_MSG, version is set to the version of the message that
+ * was hashed; it changes with every write. For IOCTL_HASH_BUF, the len
+ * bytes at buf are hashed.
+ */
+#define CHARDEV2_HASH_CRC32C 0 /* CRC32C, in the low 32 bits of digest */
+#define CHARDEV2_HASH_XXHASH64 1 /* xxHash64, with seed 0 */
+struct chardev2_digest {
+	__u32 algo;
+	__u32 len;
+	__u64 buf;
+	__u64 digest;
+	__u64 version;
+};
+#define IOCTL_HASH_MSG _IOWR(MAJOR_NUM, 3, struct chardev2_digest)
+#define IOCTL_HASH_BUF _IOWR(MAJOR_NUM, 4, struct chardev2_digest)
+/* Set, or get, how many microseconds a read() of this file spins,
+ * checking for data, before it sleeps (mode=log and mode=async). 0, the
+ * default, never spins; the most is the busy_poll_max_us parameter.
+ */
+#define IOCTL_SET_BUSY_POLL _IOW(MAJOR_NUM, 5, __u32)
+#define IOCTL_GET_BUSY_POLL _IOR(MAJOR_NUM, 6, __u32)
+/* The longest message of the log (mode=log); a longer write() only
+ * logs that much of its buffer.
+ */
+#define LOG_MSG_MAX 256
+/* The longest message of the async mode (mode=async). */
+#define ASYNC_MSG_MAX 4096
+/* What read() returns in async mode, one per read(), in the order in
+ * which the workers completed them: this header, then len bytes of
+ * output of the transform.
+ */
+struct chardev2_result {
+	__u64 seq; /* Which write() this is the result of, from 0 */
+	__s32 status; /* 0, or the negative errno of the transform */
+	__u32 len;
+};
 /* The name of the device file */
 #define DEVICE_NAME "chardev2"
 
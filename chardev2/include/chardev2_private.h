@@ -2,6 +2,11 @@
 #define CHARDEV2_PRIVATE_H_
 
 #include <chardev2.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/seqlock.h>
+#include <linux/types.h>
 
 #define BUF_LEN 80
 
@@ -10,4 +15,66 @@ enum {
 	CDEV_EXCLUSIVE_OPEN = 1,
 };
 
+enum chardev2_mode {
+	CHARDEV2_MODE_MESSAGE,
+	CHARDEV2_MODE_LOG,
+	CHARDEV2_MODE_ASYNC,
+	CHARDEV2_MODE_NUMA,
+};
+
+extern enum chardev2_mode chardev2_mode;
+
+/* The private_data of an open file. */
+struct chardev2_file {
+	struct mutex lock; /* Serializes the reads of the file */
+	u64 log_seq; /* The next message of the log to read */
+	u32 busy_poll_us; /* How long a read() spins before sleeping */
+};
+
+struct modstats;
+
+/* chardev2_main.c */
+ssize_t message_copy_to_user(const char *data, seqcount_t *seq,
+			     char __user *buffer, size_t length,
+			     loff_t *offset);
+
+/* log.c */
+int log_init(void);
+void log_exit(void);
+void log_open(struct chardev2_file *cf);
+ssize_t log_read(struct chardev2_file *cf, struct file *file,
+		 char __user *buf, size_t len);
+ssize_t log_write(const char __user *buf, size_t len);
+__poll_t log_poll(struct chardev2_file *cf, struct file *file,
+		  poll_table *wait);
+loff_t log_llseek(struct chardev2_file *cf, loff_t offset, int whence);
+
+/* async.c */
+int async_init(void);
+void async_exit(void);
+ssize_t async_read(struct chardev2_file *cf, struct file *file,
+		   char __user *buf, size_t len);
+ssize_t async_write(struct file *file, const char __user *buf, size_t len);
+__poll_t async_poll(struct file *file, poll_table *wait);
+
+/* numa.c */
+int numa_init(void);
+void numa_exit(void);
+void numa_publish(const char *message);
+ssize_t numa_read(char __user *buf, size_t len, loff_t *offset);
+
+/* busypoll.c */
+int busy_poll_init(struct modstats *stats);
+void busy_poll_exit(struct modstats *stats);
+int busy_poll_set(struct chardev2_file *cf, u32 us);
+bool busy_poll(struct chardev2_file *cf, bool (*ready)(void *arg), void *arg);
+void busy_poll_record(bool spun, u64 ts);
+
+/* hash.c */
+void hash_init(void);
+void hash_exit(void);
+int hash_message(u32 algo, const char *msg, size_t len, u64 version,
+		 u64 *digest);
+int hash_user(u32 algo, const void __user *buf, u64 len, u64 *digest);
+
 #endif /* CHARDEV2_PRIVATE_H_ */
@@ -0,0 +1,207 @@
+/* \file log.c
+ *
+ * The log of chardev2 (mode=log). A write() appends a message to a
+ * circular log of log_slots messages, and every open file reads all the
+ * messages from its own cursor, one per read(), like /dev/kmsg; several
+ * consumers thus each see the whole stream.
+ *
+ * Messages are numbered, and message seq is in slot seq % log_slots.
+ * Writers never wait for readers: a reader which falls more than
+ * log_slots messages behind finds its next message overwritten. Its
+ * read() then fails once with EPIPE, poll() reports EPOLLERR, and the
+ * reader resumes at the oldest message still in the log.
+ */
+
+#include <chardev2_private.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+static unsigned int log_slots = 1024;
+module_param(log_slots, uint, 0444);
+MODULE_PARM_DESC(log_slots, "Messages kept in log mode (default: 1024).");
+
+struct log_slot {
+	u64 ts; /* When it was written, from ktime_get_ns() */
+	u32 len;
+	char data[LOG_MSG_MAX];
+};
+
+static struct log_slot *slots;
+/* The number of the next message; the log holds those from log_first()
+ * to log_head - 1.
+ */
+static u64 log_head;
+static DEFINE_SPINLOCK(log_lock);
+/* Readers sleep here until a message arrives. */
+static DECLARE_WAIT_QUEUE_HEAD(log_wait);
+
+/* Called under log_lock. */
+static u64 log_first(void)
+{
+	return log_head > log_slots ? log_head - log_slots : 0;
+}
+
+/* Readers start at the oldest message, like those of /dev/kmsg. */
+void log_open(struct chardev2_file *cf)
+{
+	spin_lock(&log_lock);
+	cf->log_seq = log_first();
+	spin_unlock(&log_lock);
+}
+
+ssize_t log_write(const char __user *buf, size_t len)
+{
+	char data[LOG_MSG_MAX];
+	struct log_slot *slot;
+
+	len = min_t(size_t, len, LOG_MSG_MAX);
+	if (copy_from_user(data, buf, len))
+		return -EFAULT;
+
+	spin_lock(&log_lock);
+	slot = &slots[log_head & (log_slots - 1)];
+	memcpy(slot->data, data, len);
+	slot->len = len;
+	slot->ts = ktime_get_ns();
+	/* Read without the lock by log_spin_ready(). */
+	WRITE_ONCE(log_head, log_head + 1);
+	spin_unlock(&log_lock);
+
+	wake_up_interruptible(&log_wait);
+	return len;
+}
+
+static bool log_ready(struct chardev2_file *cf)
+{
+	bool ready;
+
+	spin_lock(&log_lock);
+	ready = cf->log_seq < log_head;
+	spin_unlock(&log_lock);
+	return ready;
+}
+
+/* For busy_poll(): log_head only grows, so a stale value only makes us
+ * spin a little longer.
+ */
+static bool log_spin_ready(void *arg)
+{
+	struct chardev2_file *cf = arg;
+
+	return READ_ONCE(log_head) > cf->log_seq;
+}
+
+/* Read the next message, whole; @len must be large enough for it. */
+ssize_t log_read(struct chardev2_file *cf, struct file *file,
+		 char __user *buf, size_t len)
+{
+	char data[LOG_MSG_MAX];
+	struct log_slot *slot;
+	bool waited = false, spun = false;
+	u64 ts;
+	ssize_t ret;
+
+	if (mutex_lock_interruptible(&cf->lock))
+		return -ERESTARTSYS;
+
+	spin_lock(&log_lock);
+	while (cf->log_seq >= log_head) {
+		spin_unlock(&log_lock);
+		if (file->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+		waited = true;
+		spun = busy_poll(cf, log_spin_ready, cf);
+		if (!spun) {
+			ret = wait_event_interruptible(log_wait, log_ready(cf));
+			if (ret)
+				goto out;
+		}
+		spin_lock(&log_lock);
+	}
+	if (cf->log_seq < log_first()) {
+		/* Overwritten; skip to what is left. */
+		cf->log_seq = log_first();
+		spin_unlock(&log_lock);
+		ret = -EPIPE;
+		goto out;
+	}
+	slot = &slots[cf->log_seq & (log_slots - 1)];
+	if (len < slot->len) {
+		spin_unlock(&log_lock);
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = slot->len;
+	memcpy(data, slot->data, ret);
+	ts = slot->ts;
+	cf->log_seq++;
+	spin_unlock(&log_lock);
+
+	if (waited)
+		busy_poll_record(spun, ts);
+
+	if (copy_to_user(buf, data, ret))
+		ret = -EFAULT;
+out:
+	mutex_unlock(&cf->lock);
+	return ret;
+}
+
+__poll_t log_poll(struct chardev2_file *cf, struct file *file,
+		  poll_table *wait)
+{
+	__poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+	poll_wait(file, &log_wait, wait);
+	spin_lock(&log_lock);
+	if (cf->log_seq < log_head)
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (cf->log_seq < log_first())
+		mask |= EPOLLERR | EPOLLPRI;
+	spin_unlock(&log_lock);
+	return mask;
+}
+
+/* SEEK_SET to 0 goes back to the oldest message, SEEK_END to 0 skips
+ * to the next one to be written.
+ */
+loff_t log_llseek(struct chardev2_file *cf, loff_t offset, int whence)
+{
+	if (offset)
+		return -ESPIPE;
+
+	mutex_lock(&cf->lock);
+	spin_lock(&log_lock);
+	switch (whence) {
+	case SEEK_SET:
+		cf->log_seq = log_first();
+		break;
+	case SEEK_END:
+		cf->log_seq = log_head;
+		break;
+	default:
+		offset = -EINVAL;
+	}
+	spin_unlock(&log_lock);
+	mutex_unlock(&cf->lock);
+	return offset;
+}
+
+int log_init(void)
+{
+	log_slots = roundup_pow_of_two(max(log_slots, 1U));
+	slots = vzalloc(array_size(log_slots, sizeof(*slots)));
+	return slots ? 0 : -ENOMEM;
+}
+
+void log_exit(void)
+{
+	vfree(slots);
+}
@@ -0,0 +1,87 @@
+/* \file numa.c
+ *
+ * The NUMA mode of chardev2 (mode=numa). The message is read far more
+ * often than it is written, but all its readers load the same cache
+ * lines, from the memory of one node: on a multi-socket machine, most
+ * of them cross the interconnect for every read.
+ *
+ * In this mode, every write of the message also copies it to one replica
+ * per node, allocated in the memory of that node, and read() copies from
+ * the replica of the reader's node. A write then costs one copy per
+ * node, but reads stay on their socket, and the cache lines of a replica
+ * are only shared with the other CPUs of that socket. Each replica has a
+ * sequence counter, so that a reader never sees half a write.
+ */
+
+#include <chardev2_private.h>
+#include <linux/nodemask.h>
+#include <linux/preempt.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/topology.h> /* For numa_node_id() */
+
+struct replica {
+	seqcount_t seq;
+	char data[BUF_LEN + 1];
+} ____cacheline_aligned;
+
+/* Indexed by node. */
+static struct replica **replicas;
+
+/* Called under the lock which serializes writes of the message. */
+void numa_publish(const char *message)
+{
+	int node;
+
+	for_each_node(node) {
+		struct replica *r = replicas[node];
+
+		preempt_disable();
+		write_seqcount_begin(&r->seq);
+		memcpy(r->data, message, sizeof(r->data));
+		write_seqcount_end(&r->seq);
+		preempt_enable();
+	}
+}
+
+/* Like message_read(), from the replica of our node. We may migrate to
+ * another node meanwhile, which only costs a remote read.
+ */
+ssize_t numa_read(char __user *buf, size_t len, loff_t *offset)
+{
+	struct replica *r = replicas[numa_node_id()];
+
+	return message_copy_to_user(r->data, &r->seq, buf, len, offset);
+}
+
+int numa_init(void)
+{
+	int node;
+
+	replicas = kcalloc(nr_node_ids, sizeof(*replicas), GFP_KERNEL);
+	if (!replicas)
+		return -ENOMEM;
+	/* A node without memory gets its replica from a nearby one. */
+	for_each_node(node) {
+		replicas[node] = kzalloc_node(sizeof(struct replica),
+					      GFP_KERNEL, node);
+		if (!replicas[node]) {
+			numa_exit();
+			return -ENOMEM;
+		}
+		seqcount_init(&replicas[node]->seq);
+	}
+	return 0;
+}
+
+void numa_exit(void)
+{
+	int node;
+
+	if (!replicas)
+		return;
+	for_each_node(node)
+		kfree(replicas[node]);
+	kfree(replicas);
+	replicas = NULL;
+}
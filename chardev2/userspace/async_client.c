@@ -0,0 +1,85 @@
+/*  async_client.c - drive the async mode of chardev2
+ *
+ *  Usage: ./async_client [nr_messages] [size]
+ *
+ *  With insmod chardev2.ko mode=async transform=..., writes nr_messages
+ *  messages of size bytes (100000 of 1024 by default) and reads all the
+ *  results back, with one non-blocking descriptor and poll(), then
+ *  prints the throughput and the total size of the output.
+ */
+
+#include <chardev2.h>
+
+#include <errno.h> /* errno */
+#include <fcntl.h> /* open */
+#include <linux/limits.h>
+#include <poll.h> /* poll */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit, strtol */
+#include <string.h> /* memset */
+#include <time.h> /* clock_gettime */
+#include <unistd.h> /* read, write */
+
+static char out[sizeof(struct chardev2_result) + 2 * ASYNC_MSG_MAX];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr = argc > 1 ? strtol(argv[1], NULL, 0) : 100000;
+	long size = argc > 2 ? strtol(argv[2], NULL, 0) : 1024;
+	long written = 0, done = 0, errors = 0;
+	unsigned long long out_bytes = 0;
+	char device_path[PATH_MAX], msg[ASYNC_MSG_MAX];
+	struct pollfd pfd;
+	double start, elapsed;
+	ssize_t n;
+
+	if (size < 1 || size > ASYNC_MSG_MAX) {
+		fprintf(stderr, "size must be in [1, %d]\n", ASYNC_MSG_MAX);
+		exit(EXIT_FAILURE);
+	}
+	memset(msg, 'x', size);
+	snprintf(device_path, sizeof(device_path), "/dev/%s", DEVICE_NAME);
+	pfd.fd = open(device_path, O_RDWR | O_NONBLOCK);
+	if (pfd.fd < 0) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+
+	start = now();
+	while (done < nr) {
+		pfd.events = POLLIN | (written < nr ? POLLOUT : 0);
+		if (poll(&pfd, 1, -1) < 0) {
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+		while (written < nr && write(pfd.fd, msg, size) == size)
+			written++;
+		while ((n = read(pfd.fd, out, sizeof(out))) > 0) {
+			const struct chardev2_result *res = (void *)out;
+
+			if (res->status)
+				errors++;
+			out_bytes += res->len;
+			done++;
+		}
+		if (n < 0 && errno != EAGAIN) {
+			perror("read");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	elapsed = now() - start;
+	printf("%ld messages of %ld bytes in %.3f s: %.0f messages/s, "
+	       "%llu bytes out, %ld errors\n",
+	       nr, size, elapsed, nr / elapsed, out_bytes, errors);
+	close(pfd.fd);
+	return 0;
+}
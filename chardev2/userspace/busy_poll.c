@@ -0,0 +1,152 @@
+/*  busy_poll.c - write-to-read latency of chardev2, with and without
+ *  busy-polling reads (insmod chardev2.ko mode=log, or mode=async with
+ *  transform=copy)
+ *
+ *  Usage: ./busy_poll [-a] [-u busy_poll_us] [-n count] [-i interval_us]
+ *
+ *  A writer thread writes count messages, one every interval_us (default:
+ *  200) microseconds, each holding the CLOCK_MONOTONIC time at which it is
+ *  written. The main thread reads them, on a file for which it asked for
+ *  busy_poll_us microseconds of busy-polling (default: 0, no spinning),
+ *  and prints percentiles of how long each took to arrive. With -a, the
+ *  device is in async mode, and reads return a struct chardev2_result
+ *  first. The kernel side of the story, for the reads which waited, is
+ *  in /sys/kernel/chardev2/stats/wakeup_latency.
+ */
+
+#include <chardev2.h>
+
+#include <errno.h> /* errno */
+#include <fcntl.h> /* open */
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <string.h>
+#include <sys/ioctl.h> /* ioctl */
+#include <time.h>
+#include <unistd.h> /* read, write, getopt */
+
+static int wfd;
+static unsigned long count = 10000, interval = 200;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *writer(void *arg __attribute__((unused)))
+{
+	struct timespec gap = {
+		.tv_sec = interval / 1000000,
+		.tv_nsec = interval % 1000000 * 1000,
+	};
+	unsigned long i;
+	uint64_t t;
+
+	for (i = 0; i < count; i++) {
+		if (nanosleep(&gap, NULL) && errno != EINTR) {
+			perror("nanosleep");
+			exit(EXIT_FAILURE);
+		}
+		t = now_ns();
+		if (write(wfd, &t, sizeof(t)) != sizeof(t)) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	char device_path[PATH_MAX], buf[sizeof(struct chardev2_result) + 64];
+	uint32_t us = 0;
+	uint64_t *lat, t;
+	unsigned long i;
+	pthread_t thread;
+	int async = 0, fd, opt;
+	ssize_t n;
+
+	while ((opt = getopt(argc, argv, "au:n:i:")) != -1) {
+		switch (opt) {
+		case 'a':
+			async = 1;
+			break;
+		case 'u':
+			us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-a] [-u busy_poll_us] [-n count] [-i interval_us]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	lat = calloc(count ? count : 1, sizeof(*lat));
+	if (!lat) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	snprintf(device_path, sizeof(device_path), "/dev/%s", DEVICE_NAME);
+	fd = open(device_path, O_RDONLY);
+	wfd = open(device_path, O_WRONLY);
+	if (fd < 0 || wfd < 0) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+	if (ioctl(fd, IOCTL_SET_BUSY_POLL, &us) < 0) {
+		perror("IOCTL_SET_BUSY_POLL");
+		exit(EXIT_FAILURE);
+	}
+	/* Only what we write; in async mode, there is nothing to skip. */
+	if (!async)
+		lseek(fd, 0, SEEK_END);
+
+	if (pthread_create(&thread, NULL, writer, NULL)) {
+		perror("pthread_create");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < count; i++) {
+		n = read(fd, buf, sizeof(buf));
+		t = now_ns();
+		if (n < 0) {
+			perror("read");
+			exit(EXIT_FAILURE);
+		}
+		if (async)
+			memcpy(&lat[i], buf + sizeof(struct chardev2_result),
+			       sizeof(lat[i]));
+		else
+			memcpy(&lat[i], buf, sizeof(lat[i]));
+		lat[i] = t - lat[i];
+	}
+	pthread_join(thread, NULL);
+
+	qsort(lat, count, sizeof(*lat), cmp_u64);
+	if (count)
+		printf("busy_poll %u us, %lu reads: p50 %llu ns, p90 %llu ns, p99 %llu ns, max %llu ns\n",
+		       us, count, (unsigned long long)lat[count / 2],
+		       (unsigned long long)lat[count * 9 / 10],
+		       (unsigned long long)lat[count * 99 / 100],
+		       (unsigned long long)lat[count - 1]);
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*  hash.c - hash with chardev2, without copying the data back
+ *
+ *  Usage: ./hash crc32c|xxhash64 [file]
+ *
+ *  Without a file, prints the digest of the current message of the
+ *  device (IOCTL_HASH_MSG), and the version of the message; asking
+ *  again before the next write is answered from the cache. With a
+ *  file, maps it and hashes it with IOCTL_HASH_BUF.
+ */
+
+#include <chardev2.h>
+
+#include <fcntl.h> /* open */
+#include <linux/limits.h>
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <string.h> /* strcmp */
+#include <sys/ioctl.h> /* ioctl */
+#include <sys/mman.h> /* mmap */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h> /* close */
+
+int main(int argc, char *argv[])
+{
+	struct chardev2_digest req = { 0 };
+	char device_path[PATH_MAX];
+	unsigned long cmd = IOCTL_HASH_MSG;
+	int fd;
+
+	if (argc < 2 || argc > 3 ||
+	    (strcmp(argv[1], "crc32c") && strcmp(argv[1], "xxhash64"))) {
+		fprintf(stderr, "Usage: %s crc32c|xxhash64 [file]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	req.algo = strcmp(argv[1], "crc32c") ? CHARDEV2_HASH_XXHASH64 :
+					       CHARDEV2_HASH_CRC32C;
+
+	if (argc == 3) {
+		struct stat st;
+		void *data;
+		int file = open(argv[2], O_RDONLY);
+
+		if (file < 0 || fstat(file, &st) < 0) {
+			perror(argv[2]);
+			exit(EXIT_FAILURE);
+		}
+		if (st.st_size > 0xffffffff) {
+			fprintf(stderr, "%s: too large\n", argv[2]);
+			exit(EXIT_FAILURE);
+		}
+		data = st.st_size ? mmap(NULL, st.st_size, PROT_READ,
+					 MAP_PRIVATE, file, 0) :
+				    NULL;
+		if (data == MAP_FAILED) {
+			perror("mmap");
+			exit(EXIT_FAILURE);
+		}
+		req.buf = (unsigned long)data;
+		req.len = st.st_size;
+		cmd = IOCTL_HASH_BUF;
+	}
+
+	snprintf(device_path, sizeof(device_path), "/dev/%s", DEVICE_NAME);
+	fd = open(device_path, O_RDONLY);
+	if (fd < 0) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+	if (ioctl(fd, cmd, &req) < 0) {
+		perror("ioctl");
+		exit(EXIT_FAILURE);
+	}
+	if (cmd == IOCTL_HASH_MSG)
+		printf("%016llx version %llu\n", (unsigned long long)req.digest,
+		       (unsigned long long)req.version);
+	else
+		printf("%016llx %s\n", (unsigned long long)req.digest, argv[2]);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*  log_tail.c - follow the log of chardev2 (insmod chardev2.ko mode=log)
+ *
+ *  Usage: ./log_tail
+ *
+ *  Prints every message of the log, from the oldest one, then waits for
+ *  more. Any number of log_tail may run at once; each sees every message.
+ *  When it falls so far behind that messages were overwritten, it says so
+ *  and goes on with the oldest message left.
+ */
+
+#include <chardev2.h>
+
+#include <errno.h> /* errno */
+#include <fcntl.h> /* open */
+#include <linux/limits.h>
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <unistd.h> /* read */
+
+int main(void)
+{
+	char device_path[PATH_MAX], msg[LOG_MSG_MAX];
+	unsigned long overruns = 0;
+	ssize_t n;
+	int fd;
+
+	snprintf(device_path, sizeof(device_path), "/dev/%s", DEVICE_NAME);
+	fd = open(device_path, O_RDONLY);
+	if (fd < 0) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		n = read(fd, msg, sizeof(msg));
+		if (n < 0 && errno == EPIPE) {
+			fprintf(stderr, "overrun #%lu: messages lost\n",
+				++overruns);
+			continue;
+		}
+		if (n < 0) {
+			perror("read");
+			exit(EXIT_FAILURE);
+		}
+		printf("%.*s", (int)n, msg);
+		if (n && msg[n - 1] != '\n')
+			putchar('\n');
+		fflush(stdout);
+	}
+}
@@ -0,0 +1,137 @@
+/*  numa_bench.c - readers of the chardev2 message on every CPU
+ *
+ *  Usage: ./numa_bench [seconds] [write_interval_us]
+ *
+ *  Starts one reader thread pinned to each online CPU, each with its own
+ *  descriptor, reading the message with pread() in a loop for seconds
+ *  (5 by default), while the main thread rewrites the message every
+ *  write_interval_us (1000 by default, 0 for never). Prints the reads
+ *  per second of each node and in total.
+ *
+ *  Compare insmod chardev2.ko (one message) with mode=numa (one replica
+ *  per node); both read the message the same way, so only where it is
+ *  differs. To see the traffic between sockets, run it under
+ *      perf stat -a -e node-loads,node-load-misses ./numa_bench
+ *  where node-load-misses are the loads served by another node.
+ */
+
+#define _GNU_SOURCE
+#include <chardev2.h>
+
+#include <fcntl.h> /* open */
+#include <linux/limits.h>
+#include <pthread.h> /* pthread_create */
+#include <sched.h> /* sched_setaffinity, CPU_SET */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit, calloc */
+#include <string.h> /* strlen */
+#include <sys/syscall.h> /* SYS_getcpu */
+#include <time.h> /* nanosleep */
+#include <unistd.h> /* pread, sysconf */
+
+#define MAX_NODES 64
+
+struct reader {
+	pthread_t thread;
+	int cpu;
+	int node;
+	unsigned long long reads;
+} __attribute__((aligned(64)));
+
+static char device_path[PATH_MAX];
+static volatile int stop;
+
+static void *reader_main(void *arg)
+{
+	struct reader *r = arg;
+	unsigned int cpu, node;
+	char buf[128];
+	cpu_set_t set;
+	int fd;
+
+	CPU_ZERO(&set);
+	CPU_SET(r->cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+		r->node = -1;
+		return NULL;
+	}
+	syscall(SYS_getcpu, &cpu, &node, NULL);
+	r->node = node;
+
+	fd = open(device_path, O_RDONLY);
+	if (fd < 0) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+	while (!stop) {
+		if (pread(fd, buf, sizeof(buf), 0) < 0) {
+			perror("pread");
+			exit(EXIT_FAILURE);
+		}
+		r->reads++;
+	}
+	close(fd);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 5;
+	long interval_us = argc > 2 ? atol(argv[2]) : 1000;
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long long node_reads[MAX_NODES] = { 0 }, total = 0;
+	int node_readers[MAX_NODES] = { 0 };
+	struct timespec start, now, interval;
+	unsigned long writes = 0;
+	struct reader *readers;
+	char msg[64];
+	int fd, i;
+
+	snprintf(device_path, sizeof(device_path), "/dev/%s", DEVICE_NAME);
+	fd = open(device_path, O_WRONLY);
+	readers = calloc(nr_cpus, sizeof(*readers));
+	if (fd < 0 || !readers) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < nr_cpus; i++) {
+		readers[i].cpu = i;
+		pthread_create(&readers[i].thread, NULL, reader_main,
+			       &readers[i]);
+	}
+
+	interval.tv_sec = interval_us / 1000000;
+	interval.tv_nsec = interval_us % 1000000 * 1000;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		if (interval_us) {
+			snprintf(msg, sizeof(msg), "message %lu\n", writes++);
+			if (write(fd, msg, strlen(msg) + 1) < 0) {
+				perror("write");
+				exit(EXIT_FAILURE);
+			}
+			nanosleep(&interval, NULL);
+		} else {
+			sleep(1);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (now.tv_sec - start.tv_sec < seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_cpus; i++) {
+		pthread_join(readers[i].thread, NULL);
+		if (readers[i].node < 0 || readers[i].node >= MAX_NODES)
+			continue;
+		node_reads[readers[i].node] += readers[i].reads;
+		node_readers[readers[i].node]++;
+		total += readers[i].reads;
+	}
+	for (i = 0; i < MAX_NODES; i++)
+		if (node_readers[i])
+			printf("node %d: %d readers, %.0f reads/s\n", i,
+			       node_readers[i], (double)node_reads[i] / seconds);
+	printf("total: %.0f reads/s, %lu writes\n", (double)total / seconds,
+	       writes);
+	close(fd);
+	return 0;
+}
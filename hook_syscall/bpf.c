@@ -0,0 +1,126 @@
+/* bpf.c
+ *
+ * Let BPF programs see, filter and aggregate the hooked openat() calls.
+ *
+ * After every hooked openat(), the hook_syscall:hook_openat tracepoint
+ * fires with the struct hook_event of the call and its return value.
+ * The path is only copied while something is attached to it, so an
+ * unused tracepoint costs a patched-out branch.
+ *
+ * BPF tracing programs attached to it (SEC("tp_btf/hook_openat")), and
+ * only those, may call two kfuncs of the module:
+ * - bpf_hook_emit(ev) appends the event to the rings of
+ *   /dev/hook_syscall, so that a program decides which events are
+ *   recorded, whatever the uids and cgroups filter says;
+ * - bpf_hook_filter_match() tells whether the call passes that filter.
+ * See userspace/bpf/ for an example.
+ */
+
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include <hook_syscall_private.h>
+
+#define CREATE_TRACE_POINTS
+#include <hook_syscall_trace.h>
+
+/* Modules may register kfuncs since v6.0, __bpf_kfunc appeared in v6.4
+ * and kfunc filters in v6.5; the types of the module must be in its BTF,
+ * too.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0) && \
+	defined(CONFIG_DEBUG_INFO_BTF_MODULES)
+#define HAVE_KFUNCS 1
+#endif
+
+void openat_tracepoint(const char __user *filename, int flags, long ret)
+{
+	struct hook_event ev;
+
+	if (fill_event(&ev, filename, flags))
+		return;
+	trace_hook_openat(&ev, ret);
+}
+
+#ifdef HAVE_KFUNCS
+
+#ifndef __bpf_kfunc_start_defs /* v6.7 */
+#define __bpf_kfunc_start_defs()
+#define __bpf_kfunc_end_defs()
+#endif
+
+__bpf_kfunc_start_defs();
+
+/* Record @ev in /dev/hook_syscall. */
+__bpf_kfunc int bpf_hook_emit(const struct hook_event *ev)
+{
+	if (ev->len >= HOOK_PATH_MAX)
+		return -EINVAL;
+	append_event(ev);
+	return 0;
+}
+
+/* Whether the current call passes the uids and cgroups filter. */
+__bpf_kfunc bool bpf_hook_filter_match(void)
+{
+	return hook_filter_match();
+}
+
+__bpf_kfunc_end_defs();
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+BTF_KFUNCS_START(hook_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_hook_emit)
+BTF_ID_FLAGS(func, bpf_hook_filter_match)
+BTF_KFUNCS_END(hook_kfunc_ids)
+#else
+BTF_SET8_START(hook_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_hook_emit)
+BTF_ID_FLAGS(func, bpf_hook_filter_match)
+BTF_SET8_END(hook_kfunc_ids)
+#endif
+
+/* Any tracing program could call the kfuncs, including fentry and
+ * tp_btf programs run in hard interrupts or NMIs, which could interrupt
+ * append_event() on the same CPU and fill the same slot of its ring.
+ * Our tracepoint only fires in the task context of the hooked openat(),
+ * so only programs attached to it get the kfuncs. All the kfuncs of the
+ * module's BTF are ours, so there is no need to look at @kfunc_id.
+ */
+static int hook_kfunc_filter(const struct bpf_prog *prog, u32 kfunc_id)
+{
+	if (prog->expected_attach_type == BPF_TRACE_RAW_TP &&
+	    prog->aux->attach_func_name &&
+	    !strcmp(prog->aux->attach_func_name, "hook_openat"))
+		return 0;
+	return -EACCES;
+}
+
+static const struct btf_kfunc_id_set hook_kfunc_set = {
+	.owner = THIS_MODULE,
+	.set = &hook_kfunc_ids,
+	.filter = hook_kfunc_filter,
+};
+
+/* There is no unregistering: the kfuncs go away with the BTF of the
+ * module, and programs calling them hold a reference on the module.
+ */
+int bpf_init(void)
+{
+	return register_btf_kfunc_id_set(BPF_PROG_TYPE_TRACING,
+					 &hook_kfunc_set);
+}
+
+#else
+
+int bpf_init(void)
+{
+	return 0;
+}
+
+#endif /* HAVE_KFUNCS */
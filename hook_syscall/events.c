@@ -0,0 +1,285 @@
+/* events.c
+ *
+ * The per-CPU rings of open events, and /dev/hook_syscall which exports
+ * them.
+ */
+
+#include <linux/cred.h> /* For current_uid() */
+#include <linux/device.h> /* For class_create() */
+#include <linux/fs.h> /* For register_chrdev() */
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h> /* For roundup_pow_of_two() */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
+#include <linux/uidgid.h> /* For __kuid_val() */
+#include <linux/version.h>
+#include <linux/vmalloc.h> /* For vmalloc_user() */
+#include <linux/wait.h>
+
+#include <hook_syscall_private.h>
+
+/* Number of events in each per-CPU ring, rounded up to a power of two. */
+static unsigned int ring_size = 1024;
+module_param(ring_size, uint, 0444);
+MODULE_PARM_DESC(ring_size, "Events per CPU ring (default: 1024).");
+
+/* All the rings, one after the other; see struct hook_ring_header. */
+static void *rings;
+static unsigned int ring_bytes;
+static int major;
+static struct class *cls;
+/* Readers of /dev/hook_syscall sleep here until an event arrives. */
+static DECLARE_WAIT_QUEUE_HEAD(event_wait);
+/* Serializes read(), the consumer side of the rings. */
+static DEFINE_MUTEX(read_lock);
+
+/* The rings have a single consumer: one open file at a time, which
+ * either read()s the events or maps the rings and moves tail itself, but
+ * not both, since each would advance tail behind the other's back. A
+ * mapping holds a reference to its file, so the device is not released,
+ * and cannot be opened again, until it is unmapped too.
+ */
+enum {
+	CONSUMER_NONE,
+	CONSUMER_OPEN, /* Neither read() nor mmap() yet */
+	CONSUMER_READ,
+	CONSUMER_MMAP,
+};
+static atomic_t consumer = ATOMIC_INIT(CONSUMER_NONE);
+
+static struct hook_ring_header *ring_header(int cpu)
+{
+	return rings + (size_t)cpu * ring_bytes;
+}
+
+/* The headers are mapped writable into userspace, so we only trust
+ * them for head and tail, and always mask those with our own ring_size.
+ */
+static struct hook_event *ring_slot(struct hook_ring_header *hdr, u64 pos)
+{
+	struct hook_event *events = (void *)hdr + PAGE_SIZE;
+
+	return &events[pos & (ring_size - 1)];
+}
+
+/* Fill @ev for an openat() of @filename. */
+int fill_event(struct hook_event *ev, const char __user *filename, int flags)
+{
+	long len;
+
+	len = strncpy_from_user(ev->path, filename, sizeof(ev->path));
+	if (len < 0)
+		return len;
+	if (len == sizeof(ev->path))
+		len--; /* truncated */
+	ev->path[len] = '\0';
+	ev->len = len;
+	ev->ts = ktime_get_ns();
+	ev->pid = task_tgid_nr(current);
+	ev->uid = __kuid_val(current_uid());
+	ev->flags = flags;
+	return 0;
+}
+
+/* Append an event to the ring of the current CPU. Each ring has a
+ * single producer, since we only append with preemption disabled, so
+ * no lock or atomic operation is needed: the event is published by the
+ * release store of head, which pairs with the acquire load of the
+ * consumer.
+ */
+void append_event(const struct hook_event *ev)
+{
+	struct hook_ring_header *hdr;
+	u64 head;
+
+	preempt_disable();
+	hdr = ring_header(smp_processor_id());
+	head = READ_ONCE(hdr->head);
+	if (head - smp_load_acquire(&hdr->tail) >= ring_size) {
+		hdr->dropped++;
+	} else {
+		memcpy(ring_slot(hdr, head), ev,
+		       offsetof(struct hook_event, path) + ev->len + 1);
+		smp_store_release(&hdr->head, head + 1);
+	}
+	preempt_enable();
+
+	if (wq_has_sleeper(&event_wait))
+		wake_up_interruptible(&event_wait);
+}
+
+/* Every openat() is counted in the top-N, if enabled, but only those
+ * which passed the filter are recorded as events.
+ */
+void record_openat(const char __user *filename, int flags, bool filtered)
+{
+	struct hook_event ev;
+
+	if (!filtered && !topn_enabled())
+		return;
+	/* May fault, so copy before disabling preemption. */
+	if (fill_event(&ev, filename, flags))
+		return;
+	topn_record(ev.path, ev.len);
+	if (filtered)
+		append_event(&ev);
+}
+
+/* The first read() or mmap() of the consumer picks how it consumes. */
+static int consume_by(int how)
+{
+	int old = atomic_cmpxchg(&consumer, CONSUMER_OPEN, how);
+
+	return old == CONSUMER_OPEN || old == how ? 0 : -EBUSY;
+}
+
+static bool rings_empty(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct hook_ring_header *hdr = ring_header(cpu);
+
+		if (smp_load_acquire(&hdr->head) != READ_ONCE(hdr->tail))
+			return false;
+	}
+	return true;
+}
+
+/* Copy whole events, ring after ring, so they are not in time order. */
+static ssize_t events_read(struct file *file, char __user *buf, size_t count,
+			   loff_t *ppos)
+{
+	size_t done = 0;
+	bool fault = false;
+	int cpu, ret;
+
+	if (count < sizeof(struct hook_event))
+		return -EINVAL;
+	ret = consume_by(CONSUMER_READ);
+	if (ret)
+		return ret;
+
+	while (!done) {
+		if (rings_empty()) {
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			ret = wait_event_interruptible(event_wait,
+						       !rings_empty());
+			if (ret)
+				return ret;
+		}
+
+		mutex_lock(&read_lock);
+		for_each_possible_cpu(cpu) {
+			struct hook_ring_header *hdr = ring_header(cpu);
+			u64 tail = READ_ONCE(hdr->tail);
+			u64 head = smp_load_acquire(&hdr->head);
+
+			while (tail != head &&
+			       count - done >= sizeof(struct hook_event)) {
+				if (copy_to_user(buf + done,
+						 ring_slot(hdr, tail),
+						 sizeof(struct hook_event))) {
+					fault = true;
+					break;
+				}
+				done += sizeof(struct hook_event);
+				tail++;
+			}
+			/* Hand the slots back to the producer. */
+			smp_store_release(&hdr->tail, tail);
+		}
+		mutex_unlock(&read_lock);
+		if (fault && !done)
+			return -EFAULT;
+	}
+	return done;
+}
+
+static __poll_t events_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &event_wait, wait);
+	return rings_empty() ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+/* Map all the rings. A consumer of the mapping advances tail itself. */
+static int events_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	int ret = consume_by(CONSUMER_MMAP);
+
+	if (ret)
+		return ret;
+	return remap_vmalloc_range(vma, rings, vma->vm_pgoff);
+}
+
+static int events_open(struct inode *inode, struct file *file)
+{
+	if (atomic_cmpxchg(&consumer, CONSUMER_NONE, CONSUMER_OPEN) !=
+	    CONSUMER_NONE)
+		return -EBUSY;
+	return 0;
+}
+
+static int events_release(struct inode *inode, struct file *file)
+{
+	atomic_set(&consumer, CONSUMER_NONE);
+	return 0;
+}
+
+static struct file_operations events_fops = {
+	.owner = THIS_MODULE,
+	.read = events_read,
+	.poll = events_poll,
+	.mmap = events_mmap,
+	.open = events_open,
+	.release = events_release,
+	.llseek = noop_llseek,
+};
+
+int events_init(void)
+{
+	int cpu;
+
+	ring_size = roundup_pow_of_two(max(ring_size, 1U));
+	ring_bytes = PAGE_ALIGN(PAGE_SIZE +
+				ring_size * sizeof(struct hook_event));
+	/* Zeroed, and suitable for remap_vmalloc_range(). */
+	rings = vmalloc_user((size_t)nr_cpu_ids * ring_bytes);
+	if (!rings)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		struct hook_ring_header *hdr = ring_header(cpu);
+
+		hdr->nr_slots = ring_size;
+		hdr->event_size = sizeof(struct hook_event);
+		hdr->nr_rings = nr_cpu_ids;
+		hdr->ring_bytes = ring_bytes;
+	}
+
+	major = register_chrdev(0, HOOK_DEVICE_NAME, &events_fops);
+	if (major < 0) {
+		vfree(rings);
+		return major;
+	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	cls = class_create(HOOK_DEVICE_NAME);
+#else
+	cls = class_create(THIS_MODULE, HOOK_DEVICE_NAME);
+#endif
+	device_create(cls, NULL, MKDEV(major, 0), NULL, HOOK_DEVICE_NAME);
+	return 0;
+}
+
+void events_exit(void)
+{
+	device_destroy(cls, MKDEV(major, 0));
+	class_destroy(cls);
+	unregister_chrdev(major, HOOK_DEVICE_NAME);
+	vfree(rings);
+}
@@ -0,0 +1,286 @@
+/* filter.c
+ *
+ * Which calls are recorded: the sets of UIDs and cgroups we spy on.
+ *
+ *     $ echo 1000 1001 1002 > /sys/kernel/hook_syscall/uids
+ *     $ stat -c %i /sys/fs/cgroup/system.slice/foo.service
+ *     4242
+ *     $ echo 4242 > /sys/kernel/hook_syscall/cgroups
+ *
+ * A call is recorded when its UID is in uids and its (cgroup v2) cgroup
+ * is in cgroups; an empty set does not constrain, but when both are
+ * empty nothing is recorded. Writing replaces a whole set.
+ *
+ * The sets are checked on every hooked call, so they are read without
+ * any lock: each set is an immutable hash table published with
+ * rcu_assign_pointer(). A write builds a new table, swaps the pointer,
+ * and frees the old table after a grace period, when no reader can still
+ * be using it.
+ */
+
+#include <linux/cgroup.h>
+#include <linux/cred.h> /* For current_uid() */
+#include <linux/hash.h>
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/uidgid.h> /* For __kuid_val() */
+
+#include <hook_syscall_private.h>
+
+/* UID we want to spy on - will be filled from the command line. It
+ * only seeds the uids set; change that one at runtime instead.
+ */
+static uid_t uid = -1;
+module_param(uid, int, 0444);
+MODULE_PARM_DESC(uid, "The initial UID to spy on.");
+
+#define EMPTY_SLOT U64_MAX
+
+/* An open-addressing hash set of ids, at most half full, so that a
+ * lookup only probes a couple of slots.
+ */
+struct id_set {
+	struct rcu_head rcu;
+	unsigned int bits;
+	unsigned int nr;
+	u64 slots[];
+};
+
+static struct id_set __rcu *uid_set;
+static struct id_set __rcu *cgroup_set;
+/* Serializes the writers of the two pointers above. */
+static DEFINE_MUTEX(filter_lock);
+
+static bool id_set_contains(const struct id_set *set, u64 id)
+{
+	unsigned int mask = (1U << set->bits) - 1;
+	unsigned int i = hash_64(id, set->bits);
+
+	for (;; i = (i + 1) & mask) {
+		if (set->slots[i] == id)
+			return true;
+		if (set->slots[i] == EMPTY_SLOT)
+			return false;
+	}
+}
+
+static void id_set_add(struct id_set *set, u64 id)
+{
+	unsigned int mask = (1U << set->bits) - 1;
+	unsigned int i = hash_64(id, set->bits);
+
+	for (;; i = (i + 1) & mask) {
+		if (set->slots[i] == id)
+			return;
+		if (set->slots[i] == EMPTY_SLOT) {
+			set->slots[i] = id;
+			set->nr++;
+			return;
+		}
+	}
+}
+
+static struct id_set *id_set_alloc(unsigned int max_ids)
+{
+	unsigned int bits = ilog2(roundup_pow_of_two(max(2 * max_ids, 2U)));
+	struct id_set *set;
+
+	set = kmalloc(struct_size(set, slots, 1U << bits), GFP_KERNEL);
+	if (!set)
+		return NULL;
+	set->bits = bits;
+	set->nr = 0;
+	memset(set->slots, 0xff, sizeof(u64) << bits);
+	return set;
+}
+
+/* Parse a list of ids separated by spaces, commas or newlines into a
+ * new set; an empty list gives NULL.
+ */
+static struct id_set *id_set_parse(const char *buf, u64 max_id, int *error)
+{
+	char *copy, *cur, *tok;
+	struct id_set *set = NULL;
+	unsigned int max_ids = 0;
+	const char *p;
+	u64 id;
+
+	*error = 0;
+	/* There is at most one more id than there are separators. */
+	for (p = buf; *p; p++)
+		max_ids += !!strchr(" ,\n", *p);
+	copy = kstrdup(buf, GFP_KERNEL);
+	if (!copy) {
+		*error = -ENOMEM;
+		return NULL;
+	}
+
+	cur = copy;
+	while ((tok = strsep(&cur, " ,\n"))) {
+		if (!*tok)
+			continue;
+		if (kstrtou64(tok, 0, &id) || id > max_id) {
+			*error = -EINVAL;
+			break;
+		}
+		if (!set) {
+			set = id_set_alloc(max_ids + 1);
+			if (!set) {
+				*error = -ENOMEM;
+				break;
+			}
+		}
+		id_set_add(set, id);
+	}
+	kfree(copy);
+
+	if (*error) {
+		kfree(set);
+		return NULL;
+	}
+	return set;
+}
+
+static void id_set_publish(struct id_set __rcu **ptr, struct id_set *set)
+{
+	struct id_set *old;
+
+	mutex_lock(&filter_lock);
+	old = rcu_dereference_protected(*ptr, lockdep_is_held(&filter_lock));
+	rcu_assign_pointer(*ptr, set);
+	mutex_unlock(&filter_lock);
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+static ssize_t id_set_show(struct id_set __rcu **ptr, char *buf)
+{
+	const struct id_set *set;
+	ssize_t len = 0;
+	unsigned int i;
+
+	rcu_read_lock();
+	set = rcu_dereference(*ptr);
+	for (i = 0; set && i < 1U << set->bits; i++) {
+		if (set->slots[i] == EMPTY_SLOT)
+			continue;
+		/* Stop rather than overflow the page. */
+		if (len + 22 > PAGE_SIZE)
+			break;
+		len += sprintf(buf + len, "%llu ", set->slots[i]);
+	}
+	rcu_read_unlock();
+	if (len)
+		buf[len - 1] = '\n';
+	return len;
+}
+
+/* Whether the current call should be recorded. Called on every hooked
+ * call: no lock, and no shared cache line written.
+ */
+bool hook_filter_match(void)
+{
+	const struct id_set *uids, *cgroups;
+	bool match;
+
+	rcu_read_lock();
+	uids = rcu_dereference(uid_set);
+	cgroups = rcu_dereference(cgroup_set);
+	match = uids || cgroups;
+	if (match && uids)
+		match = id_set_contains(uids, __kuid_val(current_uid()));
+#ifdef CONFIG_CGROUPS
+	if (match && cgroups)
+		match = id_set_contains(cgroups,
+					cgroup_id(task_dfl_cgroup(current)));
+#endif
+	rcu_read_unlock();
+
+	return match;
+}
+
+static ssize_t uids_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	return id_set_show(&uid_set, buf);
+}
+
+static ssize_t uids_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t count)
+{
+	int error;
+	struct id_set *set = id_set_parse(buf, U32_MAX - 1, &error);
+
+	if (error)
+		return error;
+	id_set_publish(&uid_set, set);
+	return count;
+}
+
+static ssize_t cgroups_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	return id_set_show(&cgroup_set, buf);
+}
+
+static ssize_t cgroups_store(struct kobject *kobj, struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	int error;
+	struct id_set *set = id_set_parse(buf, EMPTY_SLOT - 1, &error);
+
+	if (error)
+		return error;
+	id_set_publish(&cgroup_set, set);
+	return count;
+}
+
+static struct kobj_attribute uids_attribute = __ATTR_RW(uids);
+static struct kobj_attribute cgroups_attribute = __ATTR_RW(cgroups);
+
+static struct attribute *filter_attrs[] = {
+	&uids_attribute.attr,
+	&cgroups_attribute.attr,
+	NULL,
+};
+
+static const struct attribute_group filter_group = {
+	.attrs = filter_attrs,
+};
+
+int filter_init(struct kobject *kobj)
+{
+	int error;
+
+	if (uid != (uid_t)-1) {
+		struct id_set *set = id_set_alloc(1);
+
+		if (!set)
+			return -ENOMEM;
+		id_set_add(set, uid);
+		rcu_assign_pointer(uid_set, set);
+	}
+	error = sysfs_create_group(kobj, &filter_group);
+	if (error) {
+		/* Nothing is hooked yet, so no reader can hold the set. */
+		kfree(rcu_dereference_protected(uid_set, true));
+		RCU_INIT_POINTER(uid_set, NULL);
+	}
+	return error;
+}
+
+void filter_exit(struct kobject *kobj)
+{
+	sysfs_remove_group(kobj, &filter_group);
+	/* Called once nothing is hooked any more. */
+	kfree(rcu_dereference_protected(uid_set, true));
+	kfree(rcu_dereference_protected(cgroup_set, true));
+}
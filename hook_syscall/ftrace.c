@@ -0,0 +1,96 @@
+/* ftrace.c
+ *
+ * Hook syscalls with ftrace instead of patching sys_call_table.
+ *
+ * With CONFIG_DYNAMIC_FTRACE, every traceable kernel function starts
+ * with a few bytes of nop that ftrace turns into a call to its
+ * trampoline when the function is traced. With FTRACE_OPS_FL_IPMODIFY
+ * our callback may then change the saved instruction pointer, so that
+ * the trampoline returns into our hook instead of the traced function.
+ * This is how livepatch works: no write protection to lift, and several
+ * users of ftrace cooperate instead of racing on a table.
+ *
+ * The hook calls the original function to get its behaviour. That call
+ * is traced too, but it comes from within this module, which is how we
+ * tell it apart and leave it alone.
+ */
+
+#include <linux/ftrace.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include <hook_syscall_private.h>
+
+#ifdef HAVE_FTRACE_HOOK
+
+static syscall_fn_t hook_fn;
+static unsigned long hooked_ips[HOOK_MAX_SYSCALLS];
+static int nr_hooked;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+static void notrace ftrace_thunk(unsigned long ip, unsigned long parent_ip,
+				 struct ftrace_ops *ops,
+				 struct ftrace_regs *fregs)
+{
+	struct pt_regs *regs = ftrace_get_regs(fregs);
+#else
+static void notrace ftrace_thunk(unsigned long ip, unsigned long parent_ip,
+				 struct ftrace_ops *ops, struct pt_regs *regs)
+{
+#endif
+	if (!within_module(parent_ip, THIS_MODULE))
+		instruction_pointer_set(regs, (unsigned long)hook_fn);
+}
+
+static struct ftrace_ops hook_ops = {
+	.func = ftrace_thunk,
+	.flags = FTRACE_OPS_FL_SAVE_REGS | FTRACE_OPS_FL_IPMODIFY
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+		 | FTRACE_OPS_FL_RECURSION,
+#else
+		 | FTRACE_OPS_FL_RECURSION_SAFE,
+#endif
+};
+
+int ftrace_hook_install(unsigned long **sys_call_table, const int *nrs, int n,
+			syscall_fn_t hook)
+{
+	int i, ret;
+
+	if (n > HOOK_MAX_SYSCALLS)
+		return -E2BIG;
+
+	hook_fn = hook;
+	for (i = 0; i < n; i++) {
+		unsigned long ip = (unsigned long)sys_call_table[nrs[i]];
+
+		ret = ftrace_set_filter_ip(&hook_ops, ip, 0, 0);
+		if (ret) {
+			pr_alert("ftrace_set_filter_ip(%ps) failed: %d\n",
+				 (void *)ip, ret);
+			goto error;
+		}
+		hooked_ips[nr_hooked++] = ip;
+	}
+
+	ret = register_ftrace_function(&hook_ops);
+	if (ret) {
+		pr_alert("register_ftrace_function() failed: %d\n", ret);
+		goto error;
+	}
+	return 0;
+
+error:
+	while (nr_hooked)
+		ftrace_set_filter_ip(&hook_ops, hooked_ips[--nr_hooked], 1, 0);
+	return ret;
+}
+
+void ftrace_hook_remove(void)
+{
+	unregister_ftrace_function(&hook_ops);
+	while (nr_hooked)
+		ftrace_set_filter_ip(&hook_ops, hooked_ips[--nr_hooked], 1, 0);
+}
+
+#endif /* HAVE_FTRACE_HOOK */
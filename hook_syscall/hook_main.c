@@ -0,0 +1,594 @@
+/*
+ * SYSCALL0.c
+ *
+ * System call "stealing" sample.
+ *
+ * Disables page protection at a processor level by changing the 16th bit
+ * in the cr0 register (could be Intel specific).
+ *
+ * Based on example by Peter Jay Salzman and
+ * https://bbs.archlinux.org/viewtopic.php?id=139406
+ *
+ * The files opened by the spied-on user are recorded in per-CPU rings
+ * of struct hook_event, which can be read from /dev/hook_syscall or
+ * mapped; see include/hook_syscall.h and userspace/events.c.
+ *
+ * There are two ways (backends) to hook the syscalls listed in the
+ * syscalls parameter (only openat by default):
+ * - "table" replaces their entries in sys_call_table, as above;
+ * - "ftrace" leaves the table alone and redirects the syscall functions
+ *   themselves with ftrace; see ftrace.c.
+ * With backend=auto, the default, ftrace is tried first.
+ *
+ * Which users (and cgroups) are spied on can be changed at runtime in
+ * /sys/kernel/hook_syscall; see filter.c. The latency of openat() is
+ * in /proc/hook_syscall_latency; see latency.c. With profile=1, all the
+ * hooked calls are counted by syscall and UID in /proc/hook_syscall_profile;
+ * see profile.c. With topn=N, the N paths opened the most are in
+ * /proc/hook_syscall_topn; see topn.c. BPF programs can attach to the
+ * hook_syscall:hook_openat tracepoint; see bpf.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h> /* which will have params */
+#include <linux/percpu.h>
+#include <linux/rcupdate.h> /* For synchronize_rcu_tasks() */
+#include <linux/string.h>
+#include <linux/unistd.h> /* The list of system calls */
+#include <linux/version.h>
+
+/* For the current (process) structure, we need this to know who the
+ * current user is.
+ */
+#include <linux/sched.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#include <asm/syscall.h> /* For syscall_get_nr() */
+
+#include <hook_syscall_private.h>
+#include <hook_syscall_trace.h>
+
+/* The way we access "sys_call_table" varies as kernel internal changes.
+ * - Prior to v5.4 : manual symbol lookup
+ * - v5.5 to v5.6  : use kallsyms_lookup_name()
+ * - v5.7+         : Kprobes or specific kernel module parameter
+ */
+
+/* The in-kernel calls to the ksys_close() syscall were removed in Linux v5.11+.
+ */
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5, 7, 0))
+
+#if LINUX_VERSION_CODE <= KERNEL_VERSION(5, 4, 0)
+#define HAVE_KSYS_CLOSE 1
+#include <linux/syscalls.h> /* For ksys_close() */
+#else
+#include <linux/kallsyms.h> /* For kallsyms_lookup_name */
+#endif
+
+#else
+
+#if defined(CONFIG_KPROBES)
+#define HAVE_KPROBES 1
+#include <linux/kprobes.h>
+#else
+#define HAVE_PARAM 1
+#include <linux/kallsyms.h> /* For sprint_symbol */
+/* The address of the sys_call_table, which can be obtained with looking up
+ * "/boot/System.map" or "/proc/kallsyms". When the kernel version is v5.7+,
+ * without CONFIG_KPROBES, you can input the parameter or the module will look
+ * up all the memory.
+ */
+static unsigned long sym = 0;
+module_param(sym, ulong, 0644);
+#endif /* CONFIG_KPROBES */
+
+#endif /* Version < v5.7 */
+
+static unsigned long **my_sys_call_table;
+
+/* /sys/kernel/hook_syscall */
+static struct kobject *hook_kobj;
+
+static char *backend = "auto";
+module_param(backend, charp, 0444);
+MODULE_PARM_DESC(backend, "How to hook: \"ftrace\", \"table\" or \"auto\".");
+
+enum hook_backend {
+	HOOK_NONE,
+	HOOK_TABLE,
+	HOOK_FTRACE,
+};
+
+static enum hook_backend active_backend = HOOK_NONE;
+
+/* Unloading must wait until no thread runs our code any more, including
+ * those sleeping in the original syscall, which will return into our
+ * hook. Every hooked call is counted in inflight while it runs; the
+ * count is per-CPU, so that the hot path writes no shared cache line,
+ * and it is only summed while unloading. A call may start on one CPU
+ * and end on another, so individual counters may go negative; only
+ * their sum means something.
+ */
+static DEFINE_PER_CPU(long, inflight);
+static bool draining;
+static DECLARE_WAIT_QUEUE_HEAD(drain_wait);
+
+static inline void call_enter(void)
+{
+	this_cpu_inc(inflight);
+}
+
+static inline void call_leave(void)
+{
+	this_cpu_dec(inflight);
+	if (unlikely(READ_ONCE(draining)))
+		wake_up(&drain_wait);
+}
+
+static long inflight_calls(void)
+{
+	long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += READ_ONCE(*per_cpu_ptr(&inflight, cpu));
+	return sum;
+}
+
+/* Wait until the hooked calls have all returned. Called once the hooks
+ * are removed.
+ *
+ * A thread may have entered our hook before it was removed without
+ * having counted itself yet. That window has no voluntary context
+ * switch, so a first RCU tasks grace period, which waits for every
+ * task to switch voluntarily or run in userspace, closes it: after it,
+ * the counters can only go down, and a sum of 0 cannot be a torn read.
+ * A second grace period does the same for the few instructions between
+ * call_leave() and the return from our hook.
+ *
+ * The wakeups of call_leave() are not ordered against draining, so we
+ * also look again every jiffy, rather than rely on them alone.
+ */
+static void drain_calls(void)
+{
+	synchronize_rcu_tasks();
+	WRITE_ONCE(draining, true);
+	while (inflight_calls())
+		wait_event_timeout(drain_wait, !inflight_calls(), 1);
+	synchronize_rcu_tasks();
+}
+
+/* A pointer to the original function of each hooked system call. The
+ * reason we keep this, rather than call the original function (e.g.
+ * sys_openat), is because somebody else might have replaced the system
+ * call before us. Note that this is not 100% safe, because if another
+ * module replaced sys_openat before us, then when we are inserted, we
+ * will call the function in that module - and it might be removed
+ * before we are.
+ *
+ * Another reason for this is that we can not get sys_openat.
+ * It is a static variable, so it is not exported.
+ */
+#ifdef CONFIG_ARCH_HAS_SYSCALL_WRAPPER
+
+static int syscalls[HOOK_MAX_SYSCALLS] = { __NR_openat };
+static int nr_syscalls = 1;
+module_param_array(syscalls, int, &nr_syscalls, 0444);
+MODULE_PARM_DESC(syscalls, "Numbers of the syscalls to hook (default: openat).");
+
+static syscall_fn_t original_calls[NR_syscalls];
+
+/* The function all hooked system calls are routed to, by either
+ * backend. With syscall wrappers, every system call takes a single
+ * struct pt_regs, the registers of the calling process, from which we
+ * get the syscall number and the arguments.
+ */
+static long do_hooked_syscall(const struct pt_regs *regs)
+{
+	struct pt_regs *uregs = (struct pt_regs *)regs;
+	int nr = syscall_get_nr(current, uregs);
+	unsigned long args[6];
+
+#ifdef __X32_SYSCALL_BIT
+	/* x32 calls come with this bit set, to the same handlers as their
+	 * x86-64 numbers, which are those we hooked.
+	 */
+	nr &= ~__X32_SYSCALL_BIT;
+#endif
+	if (unlikely(nr < 0 || nr >= NR_syscalls || !original_calls[nr]))
+		return -ENOSYS;
+
+	profile_record(nr);
+
+	if (nr == __NR_openat) {
+		bool filtered = hook_filter_match();
+		const char __user *filename;
+		u64 start;
+		long ret;
+		int flags;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
+		syscall_get_arguments(current, uregs, args);
+#else
+		syscall_get_arguments(current, uregs, 0, 6, args);
+#endif
+		filename = (const char __user *)args[1];
+		flags = (int)args[2];
+
+		/* Report the file, if relevant */
+		record_openat(filename, flags, filtered);
+
+		start = ktime_get_ns();
+		ret = original_calls[nr](regs);
+		latency_record(ktime_get_ns() - start, ret, filtered);
+
+		if (trace_hook_openat_enabled())
+			openat_tracepoint(filename, flags, ret);
+		return ret;
+	}
+
+	/* Call the original system call - otherwise, we lose the ability
+	 * to e.g. open files.
+	 */
+	return original_calls[nr](regs);
+}
+
+static asmlinkage long hooked_syscall(const struct pt_regs *regs)
+{
+	long ret;
+
+	call_enter();
+	ret = do_hooked_syscall(regs);
+	call_leave();
+	return ret;
+}
+
+#define HOOK_ENTRY hooked_syscall
+
+#else /* !CONFIG_ARCH_HAS_SYSCALL_WRAPPER */
+
+/* Without syscall wrappers, each system call has its own prototype, so
+ * we can only hook the one we wrote a replacement for.
+ */
+static int syscalls[] = { __NR_openat };
+static int nr_syscalls = 1;
+
+static void *original_calls[NR_syscalls];
+
+/* The function we will replace sys_openat (the function called when you
+ * call the open system call) with. To find the exact prototype, with
+ * the number and type of arguments, we find the original function first
+ * (it is at fs/open.c).
+ *
+ * In theory, this means that we are tied to the current version of the
+ * kernel. In practice, the system calls almost never change (it would
+ * wreck havoc and require programs to be recompiled, since the system
+ * calls are the interface between the kernel and the processes).
+ */
+static asmlinkage long our_sys_openat(int dfd, const char __user *filename,
+				      int flags, umode_t mode)
+{
+	asmlinkage long (*original_call)(int, const char __user *, int,
+					 umode_t) = original_calls[__NR_openat];
+	bool filtered;
+	u64 start;
+	long ret;
+
+	call_enter();
+	filtered = hook_filter_match();
+	profile_record(__NR_openat);
+
+	/* Report the file, if relevant */
+	record_openat(filename, flags, filtered);
+
+	/* Call the original sys_openat - otherwise, we lose the ability to
+	 * open files.
+	 */
+	start = ktime_get_ns();
+	ret = original_call(dfd, filename, flags, mode);
+	latency_record(ktime_get_ns() - start, ret, filtered);
+	if (trace_hook_openat_enabled())
+		openat_tracepoint(filename, flags, ret);
+	call_leave();
+	return ret;
+}
+
+#define HOOK_ENTRY our_sys_openat
+
+#endif /* CONFIG_ARCH_HAS_SYSCALL_WRAPPER */
+
+static unsigned long **acquire_sys_call_table(void)
+{
+#ifdef HAVE_KSYS_CLOSE
+	unsigned long int offset = PAGE_OFFSET;
+	unsigned long **sct;
+
+	while (offset < ULLONG_MAX) {
+		sct = (unsigned long **)offset;
+
+		if (sct[__NR_close] == (unsigned long *)ksys_close)
+			return sct;
+
+		offset += sizeof(void *);
+	}
+
+	return NULL;
+#endif
+
+#ifdef HAVE_PARAM
+	const char sct_name[15] = "sys_call_table";
+	char symbol[40] = { 0 };
+
+	if (sym == 0) {
+		pr_alert(
+			"For Linux v5.7+, Kprobes is the preferable way to get "
+			"symbol.\n");
+		pr_info("If Kprobes is absent, you have to specify the address of "
+			"sys_call_table symbol\n");
+		pr_info("by /boot/System.map or /proc/kallsyms, which contains all the "
+			"symbol addresses, into sym parameter.\n");
+		return NULL;
+	}
+	sprint_symbol(symbol, sym);
+	if (!strncmp(sct_name, symbol, sizeof(sct_name) - 1))
+		return (unsigned long **)sym;
+
+	return NULL;
+#endif
+
+#ifdef HAVE_KPROBES
+	unsigned long (*kallsyms_lookup_name)(const char *name);
+	struct kprobe kp = {
+		.symbol_name = "kallsyms_lookup_name",
+	};
+
+	if (register_kprobe(&kp) < 0)
+		return NULL;
+	kallsyms_lookup_name = (unsigned long (*)(const char *name))kp.addr;
+	unregister_kprobe(&kp);
+#endif
+
+	return (unsigned long **)kallsyms_lookup_name("sys_call_table");
+}
+
+#ifdef HAVE_TABLE_HOOK
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+static inline void __write_cr0(unsigned long cr0)
+{
+	asm volatile("mov %0,%%cr0" : "+r"(cr0) : : "memory");
+}
+#else
+#define __write_cr0 write_cr0
+#endif
+
+static void enable_write_protection(void)
+{
+	unsigned long cr0 = read_cr0();
+	set_bit(16, &cr0);
+	__write_cr0(cr0);
+}
+
+static void disable_write_protection(void)
+{
+	unsigned long cr0 = read_cr0();
+	clear_bit(16, &cr0);
+	__write_cr0(cr0);
+}
+
+static int hook_table(void)
+{
+	int i;
+
+	/* Since v6.9, x86-64 dispatches syscalls with a switch, in
+	 * x64_sys_call(): the table is still there, but patching it would
+	 * hook nothing.
+	 */
+	if (IS_ENABLED(CONFIG_X86_64) &&
+	    LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)) {
+		pr_alert("sys_call_table is not used to dispatch syscalls\n");
+		return -EOPNOTSUPP;
+	}
+
+	disable_write_protection();
+	for (i = 0; i < nr_syscalls; i++) {
+		int nr = syscalls[i];
+
+		/* keep track of the original function */
+		original_calls[nr] = (void *)my_sys_call_table[nr];
+		/* use our function instead */
+		my_sys_call_table[nr] = (unsigned long *)HOOK_ENTRY;
+	}
+	enable_write_protection();
+
+	active_backend = HOOK_TABLE;
+	return 0;
+}
+
+static void unhook_table(void)
+{
+	int i;
+
+	for (i = 0; i < nr_syscalls; i++) {
+		int nr = syscalls[i];
+
+		if (my_sys_call_table[nr] != (unsigned long *)HOOK_ENTRY) {
+			pr_alert("Somebody else also played with the ");
+			pr_alert("system call %d\n", nr);
+			pr_alert("The system may be left in ");
+			pr_alert("an unstable state.\n");
+		}
+	}
+
+	/* Return the system calls back to normal */
+	disable_write_protection();
+	for (i = 0; i < nr_syscalls; i++)
+		my_sys_call_table[syscalls[i]] =
+			(unsigned long *)original_calls[syscalls[i]];
+	enable_write_protection();
+}
+
+#else
+
+static int hook_table(void)
+{
+	return -EOPNOTSUPP;
+}
+
+static void unhook_table(void)
+{
+}
+
+#endif /* HAVE_TABLE_HOOK */
+
+#ifdef HAVE_FTRACE_HOOK
+
+static int hook_ftrace(void)
+{
+	int i, ret;
+
+	for (i = 0; i < nr_syscalls; i++)
+		original_calls[syscalls[i]] =
+			(syscall_fn_t)my_sys_call_table[syscalls[i]];
+	ret = ftrace_hook_install(my_sys_call_table, syscalls, nr_syscalls,
+				  hooked_syscall);
+	if (ret)
+		return ret;
+
+	active_backend = HOOK_FTRACE;
+	return 0;
+}
+
+static void unhook_ftrace(void)
+{
+	ftrace_hook_remove();
+}
+
+#else
+
+static int hook_ftrace(void)
+{
+	return -EOPNOTSUPP;
+}
+
+static void unhook_ftrace(void)
+{
+}
+
+#endif /* HAVE_FTRACE_HOOK */
+
+/* Reject numbers out of the table, and duplicates, which would make us
+ * save our own hook as the original function.
+ */
+static int check_syscalls(void)
+{
+	int i, j;
+
+	for (i = 0; i < nr_syscalls; i++) {
+		if (syscalls[i] < 0 || syscalls[i] >= NR_syscalls)
+			return -EINVAL;
+		for (j = 0; j < i; j++)
+			if (syscalls[j] == syscalls[i])
+				return -EINVAL;
+	}
+	return 0;
+}
+
+static int __init syscall_start(void)
+{
+	int ret;
+
+	if (!(my_sys_call_table = acquire_sys_call_table()))
+		return -1;
+
+	ret = check_syscalls();
+	if (ret) {
+		pr_alert("Invalid syscalls parameter\n");
+		return ret;
+	}
+
+	hook_kobj = kobject_create_and_add("hook_syscall", kernel_kobj);
+	if (!hook_kobj)
+		return -ENOMEM;
+
+	ret = filter_init(hook_kobj);
+	if (ret)
+		goto put_kobj;
+
+	ret = events_init();
+	if (ret)
+		goto exit_filter;
+
+	ret = latency_init();
+	if (ret)
+		goto exit_events;
+
+	ret = profile_init(syscalls, nr_syscalls);
+	if (ret)
+		goto exit_latency;
+
+	ret = topn_init();
+	if (ret)
+		goto exit_profile;
+
+	/* BPF programs are optional, so go on without them. */
+	if (bpf_init())
+		pr_warn("Could not register the kfuncs\n");
+
+	if (!strcmp(backend, "ftrace"))
+		ret = hook_ftrace();
+	else if (!strcmp(backend, "table"))
+		ret = hook_table();
+	else if (!strcmp(backend, "auto"))
+		ret = hook_ftrace() ? hook_table() : 0;
+	else
+		ret = -EINVAL;
+	if (ret) {
+		pr_alert("Could not hook with backend %s: %d\n", backend, ret);
+		goto exit_topn;
+	}
+
+	pr_info("Hooked with the %s backend\n",
+		active_backend == HOOK_FTRACE ? "ftrace" : "table");
+
+	return 0;
+
+exit_topn:
+	topn_exit();
+exit_profile:
+	profile_exit();
+exit_latency:
+	latency_exit();
+exit_events:
+	events_exit();
+exit_filter:
+	filter_exit(hook_kobj);
+put_kobj:
+	kobject_put(hook_kobj);
+	return ret;
+}
+
+static void __exit syscall_end(void)
+{
+	if (active_backend == HOOK_FTRACE)
+		unhook_ftrace();
+	else
+		unhook_table();
+
+	drain_calls();
+	topn_exit();
+	profile_exit();
+	latency_exit();
+	events_exit();
+	filter_exit(hook_kobj);
+	kobject_put(hook_kobj);
+}
+
+module_init(syscall_start);
+module_exit(syscall_end);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,55 @@
+/* \file hook_syscall.h
+ *
+ * The layout of the open events exported through /dev/hook_syscall.
+ *
+ * The definitions here have to be in a header file, because they need
+ * to be known both to the kernel module (the rings are in events.c) and
+ * the processes reading the events (in userspace/events.c).
+ */
+
+#ifndef HOOK_SYSCALL_H_
+#define HOOK_SYSCALL_H_
+
+#include <linux/types.h>
+
+/* The name of the device file */
+#define HOOK_DEVICE_NAME "hook_syscall"
+
+/* Longer paths are truncated; this makes an event 256 bytes long. */
+#define HOOK_PATH_MAX 232
+
+/* One openat() by a spied-on user. */
+struct hook_event {
+	__u64 ts; /* CLOCK_MONOTONIC, in ns */
+	__u32 pid; /* thread group id */
+	__u32 uid;
+	__s32 flags; /* the flags argument of openat() */
+	__u32 len; /* strlen(path) */
+	char path[HOOK_PATH_MAX]; /* NUL-terminated */
+};
+
+/* There is one ring of events per possible CPU. Each ring starts with
+ * this header, alone in its page, followed by nr_slots events. Events
+ * head - 1 down to tail are valid; only the module moves head and only
+ * the consumer moves tail. The rings follow each other in the mapping
+ * of /dev/hook_syscall, every ring_bytes bytes.
+ *
+ * When a ring is full, new events are dropped (and counted) rather
+ * than overwriting the ones not consumed yet.
+ *
+ * There is one consumer: /dev/hook_syscall can only be open once at a
+ * time (open() fails with EBUSY), and that file either read()s the
+ * events or mmap()s the rings, whichever it does first; the other then
+ * fails with EBUSY.
+ */
+struct hook_ring_header {
+	__u64 head;
+	__u64 tail;
+	__u64 dropped;
+	__u32 nr_slots; /* a power of two */
+	__u32 event_size;
+	__u32 nr_rings;
+	__u32 ring_bytes;
+};
+
+#endif /* HOOK_SYSCALL_H_ */
@@ -0,0 +1,78 @@
+#ifndef HOOK_SYSCALL_PRIVATE_H_
+#define HOOK_SYSCALL_PRIVATE_H_
+
+#include <hook_syscall.h>
+#include <linux/ptrace.h>
+#include <linux/unistd.h>
+#include <linux/version.h>
+
+#ifndef NR_syscalls
+#define NR_syscalls __NR_syscalls
+#endif
+
+/* Most syscalls we hook are only told apart by their number, so the
+ * generic hook, and with it the ftrace backend and hooking more than
+ * openat(), need syscalls to take their arguments in a struct pt_regs.
+ */
+#ifdef CONFIG_ARCH_HAS_SYSCALL_WRAPPER
+typedef asmlinkage long (*syscall_fn_t)(const struct pt_regs *);
+
+#if defined(CONFIG_DYNAMIC_FTRACE_WITH_REGS)
+#define HAVE_FTRACE_HOOK 1
+#endif
+#endif /* CONFIG_ARCH_HAS_SYSCALL_WRAPPER */
+
+/* At most that many syscalls can be hooked at once. */
+#define HOOK_MAX_SYSCALLS 16
+
+/* Patching sys_call_table needs to lift the write protection of cr0. */
+#ifdef CONFIG_X86
+#define HAVE_TABLE_HOOK 1
+#endif
+
+/* filter.c */
+struct kobject;
+int filter_init(struct kobject *kobj);
+void filter_exit(struct kobject *kobj);
+bool hook_filter_match(void);
+
+/* events.c */
+int events_init(void);
+void events_exit(void);
+int fill_event(struct hook_event *ev, const char __user *filename, int flags);
+void append_event(const struct hook_event *ev);
+void record_openat(const char __user *filename, int flags, bool filtered);
+
+/* bpf.c */
+int bpf_init(void);
+void openat_tracepoint(const char __user *filename, int flags, long ret);
+
+/* latency.c */
+int latency_init(void);
+void latency_exit(void);
+void latency_record(u64 ns, long ret, bool filtered);
+
+/* profile.c */
+int profile_init(const int *nrs, int n);
+void profile_exit(void);
+void profile_record(int nr);
+
+/* topn.c */
+int topn_init(void);
+void topn_exit(void);
+bool topn_enabled(void);
+void topn_record(const char *path, unsigned int len);
+
+#ifdef HAVE_FTRACE_HOOK
+/* ftrace.c
+ *
+ * Make each of the @n syscalls in @nrs jump to @hook instead of the
+ * function in @sys_call_table; @hook calls that function (not the
+ * syscall number) to get the original behaviour.
+ */
+int ftrace_hook_install(unsigned long **sys_call_table, const int *nrs, int n,
+			syscall_fn_t hook);
+void ftrace_hook_remove(void);
+#endif
+
+#endif /* HOOK_SYSCALL_PRIVATE_H_ */
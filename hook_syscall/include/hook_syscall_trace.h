@@ -0,0 +1,56 @@
+/* The hook_syscall:hook_openat tracepoint, fired after every hooked
+ * openat() while something is attached to it; see bpf.c.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hook_syscall
+
+#if !defined(HOOK_SYSCALL_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define HOOK_SYSCALL_TRACE_H_
+
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+
+#include <hook_syscall.h>
+
+/* __assign_str() lost its source argument in v6.10. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#define hook_assign_path(ev) __assign_str(path)
+#else
+#define hook_assign_path(ev) __assign_str(path, (ev)->path)
+#endif
+
+TRACE_EVENT(hook_openat,
+
+	TP_PROTO(const struct hook_event *ev, long ret),
+
+	TP_ARGS(ev, ret),
+
+	TP_STRUCT__entry(
+		__field(u32, pid)
+		__field(u32, uid)
+		__field(s32, flags)
+		__field(long, ret)
+		__string(path, ev->path)
+	),
+
+	TP_fast_assign(
+		__entry->pid = ev->pid;
+		__entry->uid = ev->uid;
+		__entry->flags = ev->flags;
+		__entry->ret = ret;
+		hook_assign_path(ev);
+	),
+
+	TP_printk("pid=%u uid=%u flags=%#x ret=%ld path=%s", __entry->pid,
+		  __entry->uid, __entry->flags, __entry->ret, __get_str(path))
+);
+
+#endif /* HOOK_SYSCALL_TRACE_H_ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hook_syscall_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,179 @@
+/* latency.c
+ *
+ * Log2 histograms of the time spent in the original openat(), in
+ * /proc/hook_syscall_latency:
+ *
+ *     # scope class count <ns buckets: [0,2) [2,4) [4,8) ...>
+ *     all ok 5120 0 0 0 0 0 0 0 0 0 12 3051 1904 ...
+ *     all enoent 872 ...
+ *
+ * Calls are broken out by the class of their return value, and, with
+ * latency_by_uid=1, the calls which pass the filter (see filter.c) are
+ * also counted in the "filtered" scope. Each CPU has its own
+ * histograms, which are only summed when read, so recording a call is
+ * a single increment of a line that no other CPU writes.
+ */
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/version.h>
+
+#include <hook_syscall_private.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define HAVE_PROC_OPS
+#endif
+
+#define PROC_NAME "hook_syscall_latency"
+
+/* Bucket i counts the calls which took [2^i, 2^(i+1)) ns, the first
+ * one also counting 0 ns and the last one everything above 2^31 ns.
+ */
+#define LAT_BUCKETS 32
+
+static bool latency_by_uid;
+module_param(latency_by_uid, bool, 0644);
+MODULE_PARM_DESC(latency_by_uid,
+		 "Also keep openat latencies of the filtered calls apart.");
+
+enum lat_scope {
+	SCOPE_ALL,
+	SCOPE_FILTERED,
+	NR_SCOPES,
+};
+
+enum lat_class {
+	CLASS_OK,
+	CLASS_ENOENT,
+	CLASS_EACCES, /* EACCES and EPERM */
+	CLASS_ERROR, /* Any other error */
+	NR_CLASSES,
+};
+
+static const char *const scope_names[NR_SCOPES] = { "all", "filtered" };
+static const char *const class_names[NR_CLASSES] = { "ok", "enoent", "eacces",
+						     "error" };
+
+struct lat_hist {
+	u64 buckets[NR_SCOPES][NR_CLASSES][LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct lat_hist, lat_hist);
+
+static enum lat_class ret_class(long ret)
+{
+	if (ret >= 0)
+		return CLASS_OK;
+	if (ret == -ENOENT)
+		return CLASS_ENOENT;
+	if (ret == -EACCES || ret == -EPERM)
+		return CLASS_EACCES;
+	return CLASS_ERROR;
+}
+
+void latency_record(u64 ns, long ret, bool filtered)
+{
+	unsigned int bucket = ns ? min(ilog2(ns), LAT_BUCKETS - 1) : 0;
+	enum lat_class class = ret_class(ret);
+
+	this_cpu_inc(lat_hist.buckets[SCOPE_ALL][class][bucket]);
+	if (filtered && READ_ONCE(latency_by_uid))
+		this_cpu_inc(lat_hist.buckets[SCOPE_FILTERED][class][bucket]);
+}
+
+/* One row per scope and class; *pos is the row number, plus one for the
+ * header, which is SEQ_START_TOKEN.
+ */
+static void *lat_seq_start(struct seq_file *s, loff_t *pos)
+{
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	return *pos <= NR_SCOPES * NR_CLASSES ? pos : NULL;
+}
+
+static void *lat_seq_next(struct seq_file *s, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return lat_seq_start(s, pos);
+}
+
+static void lat_seq_stop(struct seq_file *s, void *v)
+{
+}
+
+static int lat_seq_show(struct seq_file *s, void *v)
+{
+	u64 buckets[LAT_BUCKETS] = { 0 };
+	unsigned int scope, class, i;
+	u64 count = 0;
+	int cpu;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(s, "# scope class count <ns buckets: [0,2) [2,4) [4,8) ...>\n");
+		return 0;
+	}
+
+	scope = (*(loff_t *)v - 1) / NR_CLASSES;
+	class = (*(loff_t *)v - 1) % NR_CLASSES;
+	for_each_possible_cpu(cpu) {
+		const struct lat_hist *hist = per_cpu_ptr(&lat_hist, cpu);
+
+		for (i = 0; i < LAT_BUCKETS; i++)
+			buckets[i] += READ_ONCE(hist->buckets[scope][class][i]);
+	}
+	for (i = 0; i < LAT_BUCKETS; i++)
+		count += buckets[i];
+
+	seq_printf(s, "%s %s %llu", scope_names[scope], class_names[class],
+		   count);
+	for (i = 0; i < LAT_BUCKETS; i++)
+		seq_printf(s, " %llu", buckets[i]);
+	seq_putc(s, '\n');
+	return 0;
+}
+
+static const struct seq_operations lat_seq_ops = {
+	.start = lat_seq_start,
+	.next = lat_seq_next,
+	.stop = lat_seq_stop,
+	.show = lat_seq_show,
+};
+
+static int lat_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &lat_seq_ops);
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops lat_file_ops = {
+	.proc_open = lat_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = seq_release,
+};
+#else
+static const struct file_operations lat_file_ops = {
+	.open = lat_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+#endif
+
+int latency_init(void)
+{
+	if (!proc_create(PROC_NAME, 0444, NULL, &lat_file_ops))
+		return -ENOMEM;
+	return 0;
+}
+
+void latency_exit(void)
+{
+	remove_proc_entry(PROC_NAME, NULL);
+}
@@ -0,0 +1,298 @@
+/* profile.c
+ *
+ * With profile=1, count every call of the hooked syscalls, by syscall
+ * and by UID, like a system-wide "strace -c":
+ *
+ *     $ cat /proc/hook_syscall_profile
+ *     # interval_ns 5003012456
+ *     # nr uid count
+ *     257 1000 18234
+ *     257 0 512
+ *     110 1000 40
+ *
+ * The counts are those since the profile was last reset, which, with
+ * profile_reset=1, is whenever it is read; dividing by interval_ns then
+ * gives rates.
+ *
+ * Each CPU counts in its own table of UIDs, so that counting a call is
+ * a lookup and an increment in memory no other CPU writes. A table
+ * holds PROF_UIDS users; the calls of any further one are counted as
+ * those of "other". Reading sums the tables into a snapshot. Resetting
+ * does not touch the counters, which only their CPU writes: the reader
+ * instead keeps a copy of the counts it last saw, and subtracts it.
+ */
+
+#include <linux/cred.h> /* For current_uid() */
+#include <linux/hash.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uidgid.h> /* For __kuid_val() */
+#include <linux/version.h>
+
+#include <hook_syscall_private.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define HAVE_PROC_OPS
+#endif
+
+#define PROC_NAME "hook_syscall_profile"
+
+/* Users counted apart by each CPU, a power of two. */
+#define PROF_UIDS 32
+#define PROF_OTHER PROF_UIDS
+#define NO_UID ((uid_t)-1)
+
+static bool profile;
+module_param(profile, bool, 0644);
+MODULE_PARM_DESC(profile, "Count the hooked calls per syscall and UID.");
+
+static bool profile_reset;
+module_param(profile_reset, bool, 0644);
+MODULE_PARM_DESC(profile_reset, "Reset the profile whenever it is read.");
+
+struct prof_entry {
+	uid_t uid; /* NO_UID while free */
+	u64 count[HOOK_MAX_SYSCALLS];
+};
+
+/* PROF_UIDS entries in a hash table, and the "other" entry. */
+struct prof_table {
+	struct prof_entry entries[PROF_UIDS + 1];
+};
+
+static struct prof_table __percpu *prof;
+/* What the counters were at the last reset. Only the reader uses it. */
+static struct prof_table __percpu *prof_base;
+static u64 prof_reset_ns;
+/* Serializes the readers, which update prof_base. */
+static DEFINE_MUTEX(prof_lock);
+
+/* The index in count[] of each hooked syscall, -1 if not hooked. */
+static s8 prof_slot[NR_syscalls];
+static const int *prof_nrs;
+static int prof_nr_syscalls;
+
+static struct prof_entry *prof_lookup(struct prof_table *t, uid_t uid)
+{
+	unsigned int i = hash_32(uid, ilog2(PROF_UIDS));
+	unsigned int n;
+
+	for (n = 0; n < PROF_UIDS; n++, i = (i + 1) & (PROF_UIDS - 1)) {
+		struct prof_entry *e = &t->entries[i];
+
+		if (e->uid == uid)
+			return e;
+		if (e->uid == NO_UID) {
+			/* Only this CPU writes its table; the release
+			 * orders the zeroed counts before the uid for
+			 * readers.
+			 */
+			smp_store_release(&e->uid, uid);
+			return e;
+		}
+	}
+	return &t->entries[PROF_OTHER];
+}
+
+void profile_record(int nr)
+{
+	uid_t uid = __kuid_val(current_uid());
+	struct prof_entry *e;
+	int slot;
+
+	if (!READ_ONCE(profile))
+		return;
+	slot = prof_slot[nr];
+	if (slot < 0)
+		return;
+
+	/* Also excludes other users of the table of this CPU. */
+	e = prof_lookup(get_cpu_ptr(prof), uid);
+	WRITE_ONCE(e->count[slot], e->count[slot] + 1);
+	put_cpu_ptr(prof);
+}
+
+/* A snapshot is the list of the counts of each UID, summed over CPUs. */
+struct prof_snapshot {
+	u64 interval_ns;
+	unsigned int nr;
+	struct prof_entry entries[];
+};
+
+static int prof_cmp(const void *a, const void *b)
+{
+	uid_t x = ((const struct prof_entry *)a)->uid;
+	uid_t y = ((const struct prof_entry *)b)->uid;
+
+	return x < y ? -1 : x > y;
+}
+
+static struct prof_snapshot *prof_take_snapshot(bool reset)
+{
+	struct prof_snapshot *snap;
+	unsigned int i, j, s, n = 0;
+	u64 now = ktime_get_ns();
+	int cpu;
+
+	snap = kvzalloc(struct_size(snap, entries,
+				    nr_cpu_ids * (PROF_UIDS + 1)),
+			GFP_KERNEL);
+	if (!snap)
+		return NULL;
+
+	mutex_lock(&prof_lock);
+	for_each_possible_cpu(cpu) {
+		struct prof_table *t = per_cpu_ptr(prof, cpu);
+		struct prof_table *base = per_cpu_ptr(prof_base, cpu);
+
+		for (i = 0; i <= PROF_UIDS; i++) {
+			struct prof_entry *e = &t->entries[i];
+			struct prof_entry *out = &snap->entries[n];
+			uid_t uid = i == PROF_OTHER ? NO_UID :
+						      smp_load_acquire(&e->uid);
+
+			if (i != PROF_OTHER && uid == NO_UID)
+				continue;
+			out->uid = uid;
+			for (s = 0; s < prof_nr_syscalls; s++) {
+				u64 count = READ_ONCE(e->count[s]);
+
+				u64 *last = &base->entries[i].count[s];
+
+				out->count[s] = count - *last;
+				if (reset)
+					*last = count;
+			}
+			n++;
+		}
+	}
+	snap->interval_ns = now - prof_reset_ns;
+	if (reset)
+		prof_reset_ns = now;
+	mutex_unlock(&prof_lock);
+
+	/* Merge the entries of the same UID, "other" (NO_UID) last. */
+	sort(snap->entries, n, sizeof(snap->entries[0]), prof_cmp, NULL);
+	for (i = 0, j = 0; i < n; i++) {
+		if (j && snap->entries[j - 1].uid == snap->entries[i].uid) {
+			for (s = 0; s < prof_nr_syscalls; s++)
+				snap->entries[j - 1].count[s] +=
+					snap->entries[i].count[s];
+		} else {
+			snap->entries[j++] = snap->entries[i];
+		}
+	}
+	snap->nr = j;
+	return snap;
+}
+
+static int prof_show(struct seq_file *s, void *v)
+{
+	const struct prof_snapshot *snap = s->private;
+	unsigned int i, slot;
+
+	seq_printf(s, "# interval_ns %llu\n# nr uid count\n",
+		   snap->interval_ns);
+	for (slot = 0; slot < prof_nr_syscalls; slot++) {
+		for (i = 0; i < snap->nr; i++) {
+			const struct prof_entry *e = &snap->entries[i];
+
+			if (!e->count[slot])
+				continue;
+			if (e->uid == NO_UID)
+				seq_printf(s, "%d other %llu\n", prof_nrs[slot],
+					   e->count[slot]);
+			else
+				seq_printf(s, "%d %u %llu\n", prof_nrs[slot],
+					   e->uid, e->count[slot]);
+		}
+	}
+	return 0;
+}
+
+/* The snapshot is taken at open, so that a reset happens once per read
+ * of the whole file, however many read() calls that takes.
+ */
+static int prof_open(struct inode *inode, struct file *file)
+{
+	struct prof_snapshot *snap;
+	int ret;
+
+	snap = prof_take_snapshot(READ_ONCE(profile_reset));
+	if (!snap)
+		return -ENOMEM;
+	ret = single_open(file, prof_show, snap);
+	if (ret)
+		kvfree(snap);
+	return ret;
+}
+
+static int prof_release(struct inode *inode, struct file *file)
+{
+	kvfree(((struct seq_file *)file->private_data)->private);
+	return single_release(inode, file);
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops prof_file_ops = {
+	.proc_open = prof_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = prof_release,
+};
+#else
+static const struct file_operations prof_file_ops = {
+	.open = prof_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = prof_release,
+};
+#endif
+
+int profile_init(const int *nrs, int n)
+{
+	int i, cpu;
+
+	memset(prof_slot, -1, sizeof(prof_slot));
+	for (i = 0; i < n; i++)
+		prof_slot[nrs[i]] = i;
+	prof_nrs = nrs;
+	prof_nr_syscalls = n;
+
+	prof = alloc_percpu(struct prof_table);
+	prof_base = alloc_percpu(struct prof_table);
+	if (!prof || !prof_base)
+		goto error;
+	for_each_possible_cpu(cpu) {
+		struct prof_table *t = per_cpu_ptr(prof, cpu);
+
+		for (i = 0; i < PROF_UIDS; i++)
+			t->entries[i].uid = NO_UID;
+	}
+	prof_reset_ns = ktime_get_ns();
+
+	if (!proc_create(PROC_NAME, 0400, NULL, &prof_file_ops))
+		goto error;
+	return 0;
+
+error:
+	free_percpu(prof);
+	free_percpu(prof_base);
+	return -ENOMEM;
+}
+
+void profile_exit(void)
+{
+	remove_proc_entry(PROC_NAME, NULL);
+	free_percpu(prof);
+	free_percpu(prof_base);
+}
@@ -0,0 +1,395 @@
+/* topn.c
+ *
+ * With topn=N, aggregate the paths of every hooked openat(), whether or
+ * not it passed the UID and cgroup filter, and show the N most opened
+ * ones, with approximate counts, in /proc/hook_syscall_topn:
+ *
+ *     # interval_ns 10000132871
+ *     # count path
+ *     182340 /etc/ld.so.cache
+ *     9120 /usr/lib/locale/locale-archive
+ *
+ * The counts are those of the last complete interval of
+ * topn_interval_ms, or, with topn_interval_ms=0, those since loading.
+ *
+ * Counting every distinct path exactly would take unbounded memory, so
+ * each CPU instead counts in a count-min sketch: CMS_DEPTH rows of
+ * CMS_WIDTH counters, a path incrementing one counter per row, chosen by
+ * its hash. Collisions only ever add to a counter, so the smallest of a
+ * path's counters is an estimate which is never too low. Next to the
+ * sketch, each CPU keeps the HH_SLOTS paths with the highest estimates
+ * it has seen (the heavy hitters), which are the candidates for the top
+ * N. All of this is only written by its own CPU, with preemption
+ * disabled, so counting an open takes no lock and no atomic operation.
+ *
+ * A reader sums the sketches of all CPUs to estimate the count of each
+ * candidate. To start a new interval, the global epoch is bumped, and
+ * each CPU clears its own sketch when it next sees the new epoch.
+ */
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
+#include <linux/siphash.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include <hook_syscall_private.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define HAVE_PROC_OPS
+#endif
+
+#define PROC_NAME "hook_syscall_topn"
+
+#define CMS_DEPTH 4
+#define CMS_WIDTH 1024 /* A power of two */
+#define HH_SLOTS 32
+
+static unsigned int topn;
+module_param(topn, uint, 0444);
+MODULE_PARM_DESC(topn, "Number of most opened paths to show, 0 to disable.");
+
+static unsigned int topn_interval_ms = 10000;
+module_param(topn_interval_ms, uint, 0444);
+MODULE_PARM_DESC(topn_interval_ms,
+		 "Interval of the counts in ms, 0 for ever (default: 10000).");
+
+struct hh_entry {
+	seqcount_t seq; /* Guards hash, len and path against readers */
+	u64 hash; /* 0 while free */
+	u32 count;
+	u32 len;
+	char path[HOOK_PATH_MAX];
+};
+
+struct topn_cpu {
+	unsigned long epoch;
+	u32 sketch[CMS_DEPTH][CMS_WIDTH];
+	struct hh_entry hh[HH_SLOTS];
+} ____cacheline_aligned;
+
+static struct topn_cpu *topn_cpus;
+static unsigned long topn_epoch = 1;
+static siphash_key_t topn_key;
+
+struct topn_item {
+	u64 hash;
+	u64 count;
+	u32 len;
+	char path[HOOK_PATH_MAX];
+};
+
+struct topn_snapshot {
+	u64 interval_ns;
+	unsigned int nr;
+	struct topn_item items[];
+};
+
+/* The top paths of the last interval, under topn_lock. */
+static struct topn_snapshot *last_snapshot;
+static u64 interval_start_ns;
+static DEFINE_MUTEX(topn_lock);
+
+static void topn_rollover(struct work_struct *work);
+static DECLARE_DELAYED_WORK(topn_work, topn_rollover);
+
+/* The counter of row @row for a path hashing to @hash: the two halves
+ * of the hash give CMS_DEPTH indices, as h1 + row * h2.
+ */
+static unsigned int cms_index(u64 hash, unsigned int row)
+{
+	u32 h1 = hash, h2 = (hash >> 32) | 1;
+
+	return (h1 + row * h2) & (CMS_WIDTH - 1);
+}
+
+static u32 cms_estimate(const struct topn_cpu *c, u64 hash)
+{
+	u32 est = U32_MAX;
+	unsigned int row;
+
+	for (row = 0; row < CMS_DEPTH; row++)
+		est = min(est, READ_ONCE(c->sketch[row][cms_index(hash, row)]));
+	return est;
+}
+
+static void topn_clear(struct topn_cpu *c, unsigned long epoch)
+{
+	unsigned int i;
+
+	memset(c->sketch, 0, sizeof(c->sketch));
+	for (i = 0; i < HH_SLOTS; i++) {
+		write_seqcount_begin(&c->hh[i].seq);
+		c->hh[i].hash = 0;
+		c->hh[i].count = 0;
+		write_seqcount_end(&c->hh[i].seq);
+	}
+	WRITE_ONCE(c->epoch, epoch);
+}
+
+bool topn_enabled(void)
+{
+	return topn;
+}
+
+void topn_record(const char *path, unsigned int len)
+{
+	struct hh_entry *e, *min_e = NULL;
+	unsigned long epoch;
+	struct topn_cpu *c;
+	unsigned int row, i;
+	u32 est;
+	u64 hash;
+
+	if (!topn)
+		return;
+	hash = siphash(path, len, &topn_key) ?: 1;
+
+	c = &topn_cpus[get_cpu()];
+	epoch = READ_ONCE(topn_epoch);
+	if (unlikely(c->epoch != epoch))
+		topn_clear(c, epoch);
+
+	/* Conservative update: only raise the counters which are below
+	 * the new estimate, which keeps the others tighter.
+	 */
+	est = cms_estimate(c, hash) + 1;
+	for (row = 0; row < CMS_DEPTH; row++) {
+		u32 *counter = &c->sketch[row][cms_index(hash, row)];
+
+		if (*counter < est)
+			WRITE_ONCE(*counter, est);
+	}
+
+	for (i = 0; i < HH_SLOTS; i++) {
+		e = &c->hh[i];
+		if (e->hash == hash) {
+			e->count = est;
+			goto out;
+		}
+		if (!min_e || e->count < min_e->count)
+			min_e = e;
+	}
+	/* A new heavy hitter takes the place of the lightest one. */
+	if (min_e->count < est) {
+		write_seqcount_begin(&min_e->seq);
+		min_e->hash = hash;
+		min_e->count = est;
+		min_e->len = len;
+		memcpy(min_e->path, path, len);
+		min_e->path[len] = '\0';
+		write_seqcount_end(&min_e->seq);
+	}
+out:
+	put_cpu();
+}
+
+static int item_cmp_hash(const void *a, const void *b)
+{
+	u64 x = ((const struct topn_item *)a)->hash;
+	u64 y = ((const struct topn_item *)b)->hash;
+
+	return x < y ? -1 : x > y;
+}
+
+static int item_cmp_count(const void *a, const void *b)
+{
+	u64 x = ((const struct topn_item *)a)->count;
+	u64 y = ((const struct topn_item *)b)->count;
+
+	return x > y ? -1 : x < y;
+}
+
+/* Collect the heavy hitters of all CPUs, estimate their counts over
+ * all CPUs, and keep the topn highest.
+ */
+static struct topn_snapshot *topn_gather(void)
+{
+	unsigned long epoch = READ_ONCE(topn_epoch);
+	struct topn_snapshot *snap;
+	unsigned int i, j, n = 0;
+	int cpu;
+
+	snap = kvmalloc(struct_size(snap, items, nr_cpu_ids * HH_SLOTS),
+			GFP_KERNEL);
+	if (!snap)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		const struct topn_cpu *c = &topn_cpus[cpu];
+
+		if (READ_ONCE(c->epoch) != epoch)
+			continue;
+		for (i = 0; i < HH_SLOTS; i++) {
+			const struct hh_entry *e = &c->hh[i];
+			struct topn_item *item = &snap->items[n];
+			unsigned int seq;
+
+			do {
+				seq = read_seqcount_begin(&e->seq);
+				item->hash = e->hash;
+				item->len = e->len;
+				memcpy(item->path, e->path, sizeof(item->path));
+			} while (read_seqcount_retry(&e->seq, seq));
+			if (item->hash)
+				n++;
+		}
+	}
+
+	/* The same path may be a heavy hitter on several CPUs. */
+	sort(snap->items, n, sizeof(snap->items[0]), item_cmp_hash, NULL);
+	for (i = 0, j = 0; i < n; i++) {
+		if (j && snap->items[j - 1].hash == snap->items[i].hash)
+			continue;
+		snap->items[j++] = snap->items[i];
+	}
+	n = j;
+
+	for (i = 0; i < n; i++) {
+		snap->items[i].count = 0;
+		for_each_possible_cpu(cpu) {
+			if (READ_ONCE(topn_cpus[cpu].epoch) == epoch)
+				snap->items[i].count +=
+					cms_estimate(&topn_cpus[cpu],
+						     snap->items[i].hash);
+		}
+	}
+	sort(snap->items, n, sizeof(snap->items[0]), item_cmp_count, NULL);
+	snap->nr = min(n, topn);
+	return snap;
+}
+
+/* End an interval: keep its top paths, and start counting anew. */
+static void topn_rollover(struct work_struct *work)
+{
+	struct topn_snapshot *snap = topn_gather();
+	u64 now = ktime_get_ns();
+
+	mutex_lock(&topn_lock);
+	if (snap) {
+		snap->interval_ns = now - interval_start_ns;
+		kvfree(last_snapshot);
+		last_snapshot = snap;
+	}
+	interval_start_ns = now;
+	WRITE_ONCE(topn_epoch, topn_epoch + 1);
+	mutex_unlock(&topn_lock);
+
+	schedule_delayed_work(&topn_work, msecs_to_jiffies(topn_interval_ms));
+}
+
+static int topn_show(struct seq_file *s, void *v)
+{
+	const struct topn_snapshot *snap = s->private;
+	unsigned int i;
+
+	seq_printf(s, "# interval_ns %llu\n# count path\n", snap->interval_ns);
+	for (i = 0; i < snap->nr; i++)
+		seq_printf(s, "%llu %s\n", snap->items[i].count,
+			   snap->items[i].path);
+	return 0;
+}
+
+static int topn_open(struct inode *inode, struct file *file)
+{
+	struct topn_snapshot *snap = NULL;
+	int ret;
+
+	mutex_lock(&topn_lock);
+	if (!topn_interval_ms) {
+		snap = topn_gather();
+		if (snap)
+			snap->interval_ns = ktime_get_ns() - interval_start_ns;
+	} else if (last_snapshot) {
+		size_t size = struct_size(last_snapshot, items,
+					  last_snapshot->nr);
+
+		snap = kvmalloc(size, GFP_KERNEL);
+		if (snap)
+			memcpy(snap, last_snapshot, size);
+	} else {
+		/* The first interval is not over yet. */
+		snap = kvzalloc(sizeof(*snap), GFP_KERNEL);
+	}
+	mutex_unlock(&topn_lock);
+	if (!snap)
+		return -ENOMEM;
+
+	ret = single_open(file, topn_show, snap);
+	if (ret)
+		kvfree(snap);
+	return ret;
+}
+
+static int topn_release(struct inode *inode, struct file *file)
+{
+	kvfree(((struct seq_file *)file->private_data)->private);
+	return single_release(inode, file);
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops topn_file_ops = {
+	.proc_open = topn_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = topn_release,
+};
+#else
+static const struct file_operations topn_file_ops = {
+	.open = topn_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = topn_release,
+};
+#endif
+
+int topn_init(void)
+{
+	unsigned int i;
+	int cpu;
+
+	if (!topn)
+		return 0;
+
+	get_random_bytes(&topn_key, sizeof(topn_key));
+	topn_cpus = vzalloc(array_size(nr_cpu_ids, sizeof(*topn_cpus)));
+	if (!topn_cpus)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		for (i = 0; i < HH_SLOTS; i++)
+			seqcount_init(&topn_cpus[cpu].hh[i].seq);
+		topn_cpus[cpu].epoch = topn_epoch;
+	}
+	interval_start_ns = ktime_get_ns();
+
+	if (!proc_create(PROC_NAME, 0400, NULL, &topn_file_ops)) {
+		vfree(topn_cpus);
+		return -ENOMEM;
+	}
+	if (topn_interval_ms)
+		schedule_delayed_work(&topn_work,
+				      msecs_to_jiffies(topn_interval_ms));
+	return 0;
+}
+
+void topn_exit(void)
+{
+	if (!topn)
+		return;
+
+	remove_proc_entry(PROC_NAME, NULL);
+	cancel_delayed_work_sync(&topn_work);
+	kvfree(last_snapshot);
+	vfree(topn_cpus);
+}
@@ -0,0 +1,50 @@
+/*  openat_filter.bpf.c - choose the hook_syscall events with BPF
+ *
+ *  Attached to the hook_syscall:hook_openat tracepoint, counts the
+ *  openat() calls of each UID, and records in /dev/hook_syscall those
+ *  of target_uid (all of them if -1), or only its failed ones with
+ *  failed_only, through the bpf_hook_emit() kfunc of the module. The
+ *  loader sets both before loading.
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+extern int bpf_hook_emit(const struct hook_event *ev) __ksym;
+
+const volatile __u32 target_uid = (__u32)-1;
+const volatile bool failed_only = false;
+const volatile bool count_only = false;
+
+/* openat() calls per UID */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+	__uint(max_entries, 1024);
+	__type(key, __u32);
+	__type(value, __u64);
+} opens SEC(".maps");
+
+SEC("tp_btf/hook_openat")
+int BPF_PROG(filter_openat, const struct hook_event *ev, long ret)
+{
+	__u32 uid = ev->uid;
+	__u64 one = 1, *count;
+
+	count = bpf_map_lookup_elem(&opens, &uid);
+	if (count)
+		(*count)++;
+	else
+		bpf_map_update_elem(&opens, &uid, &one, BPF_NOEXIST);
+
+	if (count_only)
+		return 0;
+	if (target_uid != (__u32)-1 && uid != target_uid)
+		return 0;
+	if (failed_only && ret >= 0)
+		return 0;
+	bpf_hook_emit(ev);
+	return 0;
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,107 @@
+/*  openat_filter.c - load openat_filter.bpf.c
+ *
+ *  Usage: ./openat_filter [-u uid] [-f] [-c]
+ *
+ *  -u uid  only record the events of this UID;
+ *  -f      only record the failed openat() calls;
+ *  -c      record nothing, only count (to measure the cost of a program).
+ *
+ *  Once a second, prints the openat() calls of each UID counted by the
+ *  program. The recorded events are read from /dev/hook_syscall, e.g.
+ *  with ../events.
+ */
+
+#include <errno.h> /* errno */
+#include <signal.h> /* signal */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit, strtoul */
+#include <string.h> /* strerror */
+#include <unistd.h> /* getopt, sleep */
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "openat_filter.skel.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* Print the per-CPU counts of the opens map, summed. */
+static void print_counts(int map_fd, int nr_cpus)
+{
+	unsigned long long values[nr_cpus];
+	__u32 key, next;
+	__u32 *prev = NULL;
+
+	while (!bpf_map_get_next_key(map_fd, prev, &next)) {
+		unsigned long long sum = 0;
+		int i;
+
+		key = next;
+		prev = &key;
+		if (bpf_map_lookup_elem(map_fd, &key, values))
+			continue;
+		for (i = 0; i < nr_cpus; i++)
+			sum += values[i];
+		printf("uid %u: %llu\n", key, sum);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	struct openat_filter_bpf *skel;
+	int nr_cpus, opt, err;
+
+	skel = openat_filter_bpf__open();
+	if (!skel) {
+		fprintf(stderr, "Could not open the BPF program\n");
+		exit(EXIT_FAILURE);
+	}
+
+	while ((opt = getopt(argc, argv, "u:fc")) != -1) {
+		switch (opt) {
+		case 'u':
+			skel->rodata->target_uid = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			skel->rodata->failed_only = true;
+			break;
+		case 'c':
+			skel->rodata->count_only = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-u uid] [-f] [-c]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	err = openat_filter_bpf__load(skel);
+	if (!err)
+		err = openat_filter_bpf__attach(skel);
+	if (err) {
+		fprintf(stderr, "Could not load the BPF program: %s\n",
+			strerror(-err));
+		fprintf(stderr, "Is hook_syscall loaded?\n");
+		openat_filter_bpf__destroy(skel);
+		exit(EXIT_FAILURE);
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	nr_cpus = libbpf_num_possible_cpus();
+	while (!stop) {
+		sleep(1);
+		print_counts(bpf_map__fd(skel->maps.opens), nr_cpus);
+	}
+
+	openat_filter_bpf__destroy(skel);
+	return 0;
+}
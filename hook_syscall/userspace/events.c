@@ -0,0 +1,96 @@
+/*  events.c - print the files opened by the user hook_syscall spies on
+ *
+ *  Maps the per-CPU rings of /dev/hook_syscall, and consumes them
+ *  directly from the mapping, sleeping in poll() while they are empty.
+ *  Prints one "<ts> <pid> <uid> <flags> <path>" line per event.
+ */
+
+#include <hook_syscall.h>
+
+#include <fcntl.h> /* open */
+#include <inttypes.h> /* PRIu64 */
+#include <limits.h> /* PATH_MAX */
+#include <poll.h> /* poll */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <sys/mman.h> /* mmap */
+#include <unistd.h> /* close */
+
+static struct hook_ring_header *ring(void *rings, __u32 ring_bytes, __u32 i)
+{
+	return (struct hook_ring_header *)((char *)rings +
+					   (size_t)i * ring_bytes);
+}
+
+/* Print the pending events of one ring, then hand their slots back. */
+static int drain(struct hook_ring_header *hdr, long page_size)
+{
+	const struct hook_event *events =
+		(const void *)((char *)hdr + page_size);
+	__u64 head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	__u64 tail = hdr->tail;
+	int n = 0;
+
+	for (; tail != head; tail++, n++) {
+		const struct hook_event *ev =
+			&events[tail & (hdr->nr_slots - 1)];
+
+		printf("%" PRIu64 " %u %u %#x %s\n", (uint64_t)ev->ts, ev->pid,
+		       ev->uid, ev->flags, ev->path);
+	}
+	__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+	return n;
+}
+
+int main(void)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct hook_ring_header *first;
+	char device_path[PATH_MAX];
+	__u32 nr_rings, ring_bytes, i;
+	void *rings;
+	int fd;
+
+	snprintf(device_path, sizeof device_path, "/dev/%s", HOOK_DEVICE_NAME);
+	fd = open(device_path, O_RDWR);
+	if (fd < 0) {
+		perror(device_path);
+		exit(EXIT_FAILURE);
+	}
+
+	/* The first header tells how large the whole mapping is. */
+	first = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (first == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	nr_rings = first->nr_rings;
+	ring_bytes = first->ring_bytes;
+	munmap(first, page_size);
+
+	rings = mmap(NULL, (size_t)nr_rings * ring_bytes,
+		     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (rings == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int n = 0;
+
+		for (i = 0; i < nr_rings; i++)
+			n += drain(ring(rings, ring_bytes, i), page_size);
+		if (n) {
+			fflush(stdout);
+			continue;
+		}
+		if (poll(&pfd, 1, -1) < 0) {
+			perror("poll");
+			break;
+		}
+	}
+
+	close(fd);
+	return 0;
+}
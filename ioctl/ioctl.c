@@ -1,4 +1,6 @@
 /* ioctl.c
+ *
+ * Operation statistics are under /sys/kernel/ioctl/stats.
  */
 #include <linux/cdev.h>
 #include <linux/fs.h>
@@ -7,14 +9,18 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <modstats.h>
 
 #include "myheader.h"
 
+static struct modstats *stats;
+
 static long my_unlocked_ioctl(struct file *filp, unsigned int cmd,
 			      unsigned long arg)
 {
 	/* This is where the char devices output byte lies. */
 	struct my_data *ioctl_data = filp->private_data;
+	u64 start = modstats_start();
 	int retval = 0;
 	unsigned char val;
 	struct ioctl_arg data;
@@ -64,6 +70,7 @@ static long my_unlocked_ioctl(struct file *filp, unsigned int cmd,
 	}
 
 done:
+	modstats_record(stats, MODSTATS_IOCTL, start, retval);
 	return retval;
 }
 
@@ -73,6 +80,7 @@ static ssize_t my_read(struct file *filp, char __user *buf, size_t count,
 		       loff_t *f_pos)
 {
 	struct my_data *ioctl_data = filp->private_data;
+	u64 start = modstats_start();
 	unsigned char val;
 	int retval;
 	int i = 0;
@@ -92,11 +100,14 @@ static ssize_t my_read(struct file *filp, char __user *buf, size_t count,
 
 	retval = count;
 out:
+	modstats_record(stats, MODSTATS_READ, start, retval);
 	return retval;
 }
 
 static int my_close(struct inode *inode, struct file *filp)
 {
+	u64 start = modstats_start();
+
 	pr_alert("%s call.\n", __func__);
 
 	if (filp->private_data) {
@@ -104,20 +115,24 @@ static int my_close(struct inode *inode, struct file *filp)
 		filp->private_data = NULL;
 	}
 
+	modstats_record(stats, MODSTATS_RELEASE, start, 0);
 	return 0;
 }
 
 static int my_open(struct inode *inode, struct file *filp)
 {
 	struct my_data *ioctl_data;
+	u64 start = modstats_start();
 
 	pr_alert("%s call.\n", __func__);
 	/* GFP_KERNEL is for kernel-internal memory. See
            <linux/gfp_types.h>. */
 	ioctl_data = kmalloc(sizeof(struct my_data), GFP_KERNEL);
 
-	if (ioctl_data == NULL)
+	if (ioctl_data == NULL) {
+		modstats_record(stats, MODSTATS_OPEN, start, -ENOMEM);
 		return -ENOMEM;
+	}
 
 	/* Initialize the lock, make up a value, and save to filp's
            private_data field. */
@@ -125,6 +140,7 @@ static int my_open(struct inode *inode, struct file *filp)
 	ioctl_data->val = 0xFF;
 	filp->private_data = ioctl_data;
 
+	modstats_record(stats, MODSTATS_OPEN, start, 0);
 	return 0;
 }
 
@@ -135,6 +151,10 @@ static int __init ioctl_init(void)
 
 	int alloc_ret = -1;
 	int cdev_ret = -1;
+
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
 	/* Allocate some numbers for char dev registration */
 	alloc_ret = alloc_chrdev_region(&dev, 0, num_of_dev, DRIVER_NAME);
 
@@ -159,6 +179,7 @@ error:
 		cdev_del(&test_ioctl_cdev);
 	if (alloc_ret == 0)
 		unregister_chrdev_region(dev, num_of_dev);
+	modstats_unregister(stats);
 	return -1;
 }
 
@@ -171,6 +192,7 @@ static void __exit ioctl_exit(void)
 
 	cdev_del(&test_ioctl_cdev);
 	unregister_chrdev_region(dev, num_of_dev);
+	modstats_unregister(stats);
 	pr_alert("%s driver removed.\n", DRIVER_NAME);
 }
 
@@ -0,0 +1,109 @@
+/* \file modstats.h
+ *
+ * Per-module operation statistics, shared by the example modules.
+ *
+ * A module registers itself once with modstats_register(KBUILD_MODNAME)
+ * and then calls modstats_record() at the end of each of its file
+ * operations. The statistics show up under
+ *
+ *     /sys/kernel/<module>/stats/
+ *
+ * The recording side is inline and only touches per-CPU data; the sums
+ * are computed when the files are read.
+ */
+
+#ifndef MODSTATS_H_
+#define MODSTATS_H_
+
+#include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/types.h>
+
+enum modstats_op {
+	MODSTATS_OPEN,
+	MODSTATS_RELEASE,
+	MODSTATS_READ,
+	MODSTATS_WRITE,
+	MODSTATS_IOCTL,
+	MODSTATS_POLL,
+	MODSTATS_NR_OPS,
+};
+
+/* The latency histograms are log-linear: every power of two is split
+ * into 1 << MODSTATS_SUB_BITS equal buckets, so that the relative error
+ * of a bucket is at most 25%, from 1 ns up to 2^MODSTATS_MAX_SHIFT ns
+ * (about 68 s).
+ */
+#define MODSTATS_SUB_BITS 2
+#define MODSTATS_SUB_BUCKETS (1 << MODSTATS_SUB_BITS)
+#define MODSTATS_MAX_SHIFT 36
+#define MODSTATS_BUCKETS ((MODSTATS_MAX_SHIFT - 1) * MODSTATS_SUB_BUCKETS)
+
+struct modstats_cpu {
+	u64 ops[MODSTATS_NR_OPS];
+	u64 errors[MODSTATS_NR_OPS];
+	u64 bytes[MODSTATS_NR_OPS];
+	u64 latency[MODSTATS_NR_OPS][MODSTATS_BUCKETS];
+};
+
+struct modstats {
+	struct kobject kobj;
+	struct modstats_cpu __percpu *cpu;
+};
+
+struct modstats *modstats_register(const char *name);
+void modstats_unregister(struct modstats *stats);
+
+static inline unsigned int modstats_bucket(u64 ns)
+{
+	unsigned int shift;
+
+	if (ns < MODSTATS_SUB_BUCKETS)
+		return ns;
+	shift = ilog2(ns);
+	if (shift >= MODSTATS_MAX_SHIFT)
+		return MODSTATS_BUCKETS - 1;
+	return (shift - MODSTATS_SUB_BITS + 1) * MODSTATS_SUB_BUCKETS +
+	       ((ns >> (shift - MODSTATS_SUB_BITS)) &
+		(MODSTATS_SUB_BUCKETS - 1));
+}
+
+/* The smallest latency counted by @bucket, the inverse of
+ * modstats_bucket().
+ */
+static inline u64 modstats_bucket_min(unsigned int bucket)
+{
+	unsigned int shift = bucket / MODSTATS_SUB_BUCKETS + 1;
+	unsigned int sub = bucket % MODSTATS_SUB_BUCKETS;
+
+	if (bucket < MODSTATS_SUB_BUCKETS)
+		return bucket;
+	return (u64)(MODSTATS_SUB_BUCKETS + sub) << (shift - MODSTATS_SUB_BITS);
+}
+
+/* Take the start time of an operation. */
+static inline u64 modstats_start(void)
+{
+	return ktime_get_ns();
+}
+
+/* Account for an operation that started at @start and returned @ret. A
+ * negative @ret counts as an error; otherwise, for reads and writes, it
+ * is the number of bytes transferred.
+ */
+static inline void modstats_record(struct modstats *stats,
+				   enum modstats_op op, u64 start, long ret)
+{
+	struct modstats_cpu __percpu *cpu = stats->cpu;
+
+	this_cpu_inc(cpu->ops[op]);
+	if (ret < 0)
+		this_cpu_inc(cpu->errors[op]);
+	else if (op == MODSTATS_READ || op == MODSTATS_WRITE)
+		this_cpu_add(cpu->bytes[op], ret);
+	this_cpu_inc(cpu->latency[op][modstats_bucket(ktime_get_ns() - start)]);
+}
+
+#endif /* MODSTATS_H_ */
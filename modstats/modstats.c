@@ -0,0 +1,204 @@
+/* modstats.c - per-module operation statistics
+ *
+ * A small library module, loaded before the examples using it:
+ *
+ *     $ insmod modstats/modstats.ko
+ *     $ insmod chardev/chardev.ko
+ *     $ cat /sys/kernel/chardev/stats/ops
+ *
+ * Each registered module gets a kobject under /sys/kernel, as in
+ * sysfs/hello-sysfs.c, but embedded in our own struct modstats with its
+ * own kobj_type, so that the attributes can find their statistics from
+ * the kobject they are called for. The files are:
+ *
+ *     ops, errors, bytes  one "<op> <count>" line per operation
+ *     latency             "<op> <lower bound in ns> <count>" lines, for
+ *                         the non-empty buckets only
+ *     reset               write anything to zero everything
+ */
+
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+#include <modstats.h>
+
+static const char *const op_names[MODSTATS_NR_OPS] = {
+	[MODSTATS_OPEN] = "open",
+	[MODSTATS_RELEASE] = "release",
+	[MODSTATS_READ] = "read",
+	[MODSTATS_WRITE] = "write",
+	[MODSTATS_IOCTL] = "ioctl",
+	[MODSTATS_POLL] = "poll",
+};
+
+static inline struct modstats *to_modstats(struct kobject *kobj)
+{
+	return container_of(kobj, struct modstats, kobj);
+}
+
+/* Sum the u64 at @offset of struct modstats_cpu over all CPUs. */
+static u64 sum_field(struct modstats *stats, size_t offset)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(u64 *)((char *)per_cpu_ptr(stats->cpu, cpu) + offset);
+	return sum;
+}
+
+static ssize_t show_per_op(struct modstats *stats, size_t offset, char *buf)
+{
+	ssize_t len = 0;
+	int op;
+
+	for (op = 0; op < MODSTATS_NR_OPS; op++)
+		len += sprintf(buf + len, "%s %llu\n", op_names[op],
+			       sum_field(stats, offset + op * sizeof(u64)));
+	return len;
+}
+
+static ssize_t ops_show(struct kobject *kobj, struct kobj_attribute *attr,
+			char *buf)
+{
+	return show_per_op(to_modstats(kobj),
+			   offsetof(struct modstats_cpu, ops), buf);
+}
+
+static ssize_t errors_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	return show_per_op(to_modstats(kobj),
+			   offsetof(struct modstats_cpu, errors), buf);
+}
+
+static ssize_t bytes_show(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	return show_per_op(to_modstats(kobj),
+			   offsetof(struct modstats_cpu, bytes), buf);
+}
+
+static ssize_t latency_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	struct modstats *stats = to_modstats(kobj);
+	ssize_t len = 0;
+	int op, bucket;
+
+	for (op = 0; op < MODSTATS_NR_OPS; op++) {
+		size_t offset = offsetof(struct modstats_cpu, latency) +
+				op * MODSTATS_BUCKETS * sizeof(u64);
+
+		for (bucket = 0; bucket < MODSTATS_BUCKETS; bucket++) {
+			u64 count = sum_field(stats,
+					      offset + bucket * sizeof(u64));
+
+			if (!count)
+				continue;
+			/* Stop rather than overflow the page. */
+			if (len + 64 > PAGE_SIZE)
+				return len;
+			len += sprintf(buf + len, "%s %llu %llu\n",
+				       op_names[op],
+				       modstats_bucket_min(bucket), count);
+		}
+	}
+	return len;
+}
+
+/* Updates racing with the reset may survive it. */
+static ssize_t reset_store(struct kobject *kobj, struct kobj_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct modstats *stats = to_modstats(kobj);
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(stats->cpu, cpu), 0,
+		       sizeof(struct modstats_cpu));
+	return count;
+}
+
+static struct kobj_attribute ops_attribute = __ATTR_RO(ops);
+static struct kobj_attribute errors_attribute = __ATTR_RO(errors);
+static struct kobj_attribute bytes_attribute = __ATTR_RO(bytes);
+static struct kobj_attribute latency_attribute = __ATTR_RO(latency);
+static struct kobj_attribute reset_attribute = __ATTR_WO(reset);
+
+static struct attribute *modstats_attrs[] = {
+	&ops_attribute.attr,
+	&errors_attribute.attr,
+	&bytes_attribute.attr,
+	&latency_attribute.attr,
+	&reset_attribute.attr,
+	NULL,
+};
+
+/* A named group becomes a subdirectory of the kobject. */
+static const struct attribute_group modstats_group = {
+	.name = "stats",
+	.attrs = modstats_attrs,
+};
+
+static const struct attribute_group *modstats_groups[] = {
+	&modstats_group,
+	NULL,
+};
+
+/* Called by the last kobject_put(). */
+static void modstats_release(struct kobject *kobj)
+{
+	struct modstats *stats = to_modstats(kobj);
+
+	free_percpu(stats->cpu);
+	kfree(stats);
+}
+
+static struct kobj_type modstats_ktype = {
+	.release = modstats_release,
+	/* Dispatches to the show() and store() of struct kobj_attribute. */
+	.sysfs_ops = &kobj_sysfs_ops,
+	.default_groups = modstats_groups,
+};
+
+/* Create /sys/kernel/@name/stats. Returns an ERR_PTR() on failure. */
+struct modstats *modstats_register(const char *name)
+{
+	struct modstats *stats;
+	int error;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return ERR_PTR(-ENOMEM);
+	stats->cpu = alloc_percpu(struct modstats_cpu);
+	if (!stats->cpu) {
+		kfree(stats);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	/* Once initialized, the kobject owns stats: from here on it is
+	 * freed by kobject_put(), even if kobject_init_and_add() fails.
+	 */
+	error = kobject_init_and_add(&stats->kobj, &modstats_ktype,
+				     kernel_kobj, "%s", name);
+	if (error) {
+		kobject_put(&stats->kobj);
+		return ERR_PTR(error);
+	}
+	return stats;
+}
+EXPORT_SYMBOL_GPL(modstats_register);
+
+void modstats_unregister(struct modstats *stats)
+{
+	kobject_put(&stats->kobj);
+}
+EXPORT_SYMBOL_GPL(modstats_unregister);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Per-module operation statistics under /sys/kernel");
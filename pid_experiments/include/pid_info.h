@@ -0,0 +1,79 @@
+#ifndef PID_INFO_H_
+#define PID_INFO_H_
+
+/* The interface of /proc/pid_info, shared with userspace.
+ *
+ * write() an array of __s32 PIDs, as seen from the namespace of the
+ * writer, then read() back one struct pid_info_result per PID, in the
+ * same order. A write replaces the results of the previous one.
+ */
+
+#include <linux/types.h>
+
+#define PID_INFO_PROC_NAME "pid_info"
+
+/* At most that many PIDs in one write(). */
+#define PID_INFO_MAX_BATCH 4096
+
+/* A pid is numbered in at most that many namespaces (MAX_PID_NS_LEVEL
+ * nested ones, and the initial one).
+ */
+#define PID_INFO_MAX_LEVELS 33
+
+struct pid_info_result {
+	__s32 pid; /* As written */
+	__s32 error; /* 0, or -ESRCH if there is no such task */
+	__s32 tgid; /* In the namespace of the writer */
+	/* Of the pid namespace of the task, relative to that of the
+	 * writer: 0 if they are the same.
+	 */
+	__u32 level;
+	__u8 state; /* As in /proc/<pid>/stat: 'R', 'S', 'D', ... */
+	__u8 pad[3];
+	/* nr[i] is the pid in the namespace i levels below that of the
+	 * writer, for i <= level: nr[0] == pid. The pids in the ancestors of
+	 * the writer's namespace are not given.
+	 */
+	__s32 nr[PID_INFO_MAX_LEVELS];
+};
+
+/* /proc/pid_info_tasks gives a binary snapshot of all the tasks
+ * (threads) of the pid namespace of the reader: a struct
+ * pid_info_snapshot, then nr_tasks struct pid_info_task, sorted by pid.
+ *
+ * A snapshot is taken by writing a __u64 cookie, or by the first read()
+ * after opening. With the generation of the previous snapshot of the
+ * same open file as cookie, only the tasks which changed since then are
+ * in the snapshot (PID_INFO_SNAPSHOT_DELTA), including those which
+ * exited (PID_INFO_TASK_EXITED); with any other cookie, e.g. 0, all of
+ * them are.
+ */
+#define PID_INFO_TASKS_PROC_NAME "pid_info_tasks"
+
+#define PID_INFO_SNAPSHOT_DELTA 0x1
+
+struct pid_info_snapshot {
+	__u64 generation; /* The cookie for the next delta */
+	__u32 flags;
+	__u32 nr_tasks;
+	__u32 task_size; /* sizeof(struct pid_info_task) */
+	__u32 pad;
+};
+
+#define PID_INFO_TASK_EXITED 0x1
+
+struct pid_info_task {
+	__s32 pid;
+	__s32 tgid;
+	__u32 level;
+	__u8 state;
+	__u8 pad[3];
+	__u32 flags;
+	__u32 pad2;
+	__u64 utime_ns;
+	__u64 stime_ns;
+	__u64 rss_bytes;
+	char comm[16];
+};
+
+#endif /* PID_INFO_H_ */
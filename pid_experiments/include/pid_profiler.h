@@ -0,0 +1,44 @@
+#ifndef PID_PROFILER_H_
+#define PID_PROFILER_H_
+
+/* The layout of the samples exported through /dev/pid_profiler,
+ * shared by pid_profiler.c and userspace/profile.c.
+ */
+
+#include <linux/types.h>
+
+#define PROFILER_DEVICE_NAME "pid_profiler"
+
+/* At most that many frames are kept of a stack. */
+#define PROFILER_MAX_DEPTH 30
+
+/* One sample of a thread of the target: ips[] holds nr_kernel kernel
+ * frames (innermost first), then nr_user user frames. With mode=ip,
+ * there is a single frame, the interrupted instruction. The whole
+ * sample is 256 bytes long.
+ */
+struct profiler_sample {
+	__u64 ts; /* CLOCK_MONOTONIC, in ns */
+	__u32 tid;
+	__u16 nr_kernel;
+	__u16 nr_user;
+	__u64 ips[PROFILER_MAX_DEPTH];
+};
+
+/* There is one ring of samples per possible CPU, laid out as the rings
+ * of hook_syscall: this header, alone in its page, followed by
+ * nr_slots samples, samples head - 1 down to tail being valid. Only the
+ * module moves head, and only the consumer moves tail. The rings follow
+ * each other in the mapping, every ring_bytes bytes.
+ */
+struct profiler_ring_header {
+	__u64 head;
+	__u64 tail;
+	__u64 dropped;
+	__u32 nr_slots; /* a power of two */
+	__u32 sample_size;
+	__u32 nr_rings;
+	__u32 ring_bytes;
+};
+
+#endif /* PID_PROFILER_H_ */
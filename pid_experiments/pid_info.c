@@ -1,19 +1,1128 @@
+/*
+ * pid_info.c
+ *
+ * Print the pid namespace level of the process given by the pid
+ * parameter, and answer batches of such questions in /proc/pid_info;
+ * see include/pid_info.h and userspace/pid_query.c.
+ *
+ * Every PID of a batch is resolved within a single RCU read-side
+ * critical section, which is what keeps the pids and tasks we look at
+ * from being freed: a few thousand PIDs cost one system call each way,
+ * rather than an insmod each.
+ *
+ * /proc/pid_info_vmas lists the memory mappings of the process given by
+ * the pid parameter, like a cheaper /proc/<pid>/smaps:
+ *
+ *     # start-end size_kb rss_kb swap_kb name
+ *     55d0c8a00000-55d0c8a21000 132 132 0 [anon]
+ *     7f3c2e400000-7f3c2e428000 160 160 0 libc.so.6
+ *
+ * The page tables of a mapping are walked in chunks of SCAN_CHUNK bytes,
+ * each under its own hold of mmap_lock, and the walk resumes by address
+ * after every chunk; the process can fault pages in between, however
+ * large it is.
+ *
+ * /proc/pid_info_tasks gives all the tasks of the pid namespace of the
+ * reader, in one binary snapshot gathered in a single RCU traversal,
+ * or only those which changed since a previous snapshot; see
+ * include/pid_info.h and userspace/task_snapshot.c.
+ *
+ * With wss_window_ms set, /proc/pid_info_wss estimates the working set
+ * of each mapping of the process given by the pid parameter, from the
+ * accessed bits of its pages, which are cleared and tested again a
+ * window later.
+ */
+
 #include <linux/mmap_lock.h>
 #include <linux/proc_fs.h>
 #include <linux/highmem.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/atomic.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/pid.h>
+#include <linux/pid_namespace.h>
 #include <linux/mm.h>
+#include <linux/page_idle.h> /* For folio_set_young() */
+#include <linux/seq_file.h>
+#include <linux/sched/mm.h> /* For get_task_mm() */
+#include <linux/sched/signal.h> /* For for_each_process_thread() */
+#include <linux/sched/task.h> /* For task_lock() */
+#include <linux/sort.h>
+#include <linux/swapops.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include <pid_info.h>
 
 #define MODULE_NAME "pid_info"
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define HAVE_PROC_OPS
+#endif
+
+#define VMAS_PROC_NAME "pid_info_vmas"
+
+/* The most page table we walk under one hold of mmap_lock. */
+#define SCAN_CHUNK (16UL << 20)
+
 static int pid;
-module_param(pid, int, 0);
+module_param(pid, int, 0644);
 MODULE_PARM_DESC(pid, "The process ID for which we print information.");
 
+/* The results of the last batch written to an open file. */
+struct batch {
+	struct mutex lock;
+	struct pid_info_result *results;
+	size_t nr;
+	size_t read; /* Results already read */
+};
+
+static void query_pid(struct pid_namespace *ns, struct pid_info_result *res)
+{
+	struct task_struct *task;
+	struct pid *vpid;
+	unsigned int i;
+
+	vpid = find_pid_ns(res->pid, ns);
+	task = vpid ? pid_task(vpid, PIDTYPE_PID) : NULL;
+	if (!task) {
+		res->error = -ESRCH;
+		return;
+	}
+
+	res->tgid = task_tgid_nr_ns(task, ns);
+	/* Found in ns, so vpid is in ns or below. The numbers of the
+	 * ancestors of ns are not for the writer to see: a container
+	 * would learn the host PIDs of its processes.
+	 */
+	res->level = vpid->level - ns->level;
+	res->state = task_index_to_char(task_state_index(task));
+	for (i = 0; i <= res->level && i < PID_INFO_MAX_LEVELS; i++)
+		res->nr[i] = vpid->numbers[ns->level + i].nr;
+}
+
+static ssize_t batch_write(struct file *file, const char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	struct batch *batch = file->private_data;
+	struct pid_info_result *results;
+	struct pid_namespace *ns;
+	size_t i, nr = count / sizeof(__s32);
+	__s32 *pids;
+
+	if (!nr || count % sizeof(__s32) || nr > PID_INFO_MAX_BATCH)
+		return -EINVAL;
+
+	pids = memdup_user(buf, count);
+	if (IS_ERR(pids))
+		return PTR_ERR(pids);
+	results = kvcalloc(nr, sizeof(*results), GFP_KERNEL);
+	if (!results) {
+		kfree(pids);
+		return -ENOMEM;
+	}
+
+	ns = task_active_pid_ns(current);
+	rcu_read_lock();
+	for (i = 0; i < nr; i++) {
+		results[i].pid = pids[i];
+		query_pid(ns, &results[i]);
+	}
+	rcu_read_unlock();
+	kfree(pids);
+
+	mutex_lock(&batch->lock);
+	kvfree(batch->results);
+	batch->results = results;
+	batch->nr = nr;
+	batch->read = 0;
+	mutex_unlock(&batch->lock);
+
+	return count;
+}
+
+/* Copy out whole results, from where the last read() stopped. */
+static ssize_t batch_read(struct file *file, char __user *buf, size_t count,
+			  loff_t *ppos)
+{
+	struct batch *batch = file->private_data;
+	size_t nr;
+	ssize_t ret;
+
+	mutex_lock(&batch->lock);
+	nr = min(count / sizeof(*batch->results), batch->nr - batch->read);
+	if (copy_to_user(buf, batch->results + batch->read,
+			 nr * sizeof(*batch->results))) {
+		ret = -EFAULT;
+	} else {
+		batch->read += nr;
+		ret = nr * sizeof(*batch->results);
+	}
+	mutex_unlock(&batch->lock);
+
+	return ret;
+}
+
+static int batch_open(struct inode *inode, struct file *file)
+{
+	struct batch *batch = kzalloc(sizeof(*batch), GFP_KERNEL);
+
+	if (!batch)
+		return -ENOMEM;
+	mutex_init(&batch->lock);
+	file->private_data = batch;
+	return stream_open(inode, file);
+}
+
+static int batch_release(struct inode *inode, struct file *file)
+{
+	struct batch *batch = file->private_data;
+
+	kvfree(batch->results);
+	kfree(batch);
+	return 0;
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops batch_fops = {
+	.proc_open = batch_open,
+	.proc_read = batch_read,
+	.proc_write = batch_write,
+	.proc_release = batch_release,
+};
+#else
+static const struct file_operations batch_fops = {
+	.open = batch_open,
+	.read = batch_read,
+	.write = batch_write,
+	.release = batch_release,
+};
+#endif
+
+/* What we report of a VMA; a copy, since we do not keep mmap_lock. */
+struct vma_record {
+	unsigned long start, end;
+	unsigned long rss, swap;
+	char name[64];
+};
+
+struct vma_inspector {
+	/* Only mmgrab()ed; see vmas_start(). */
+	struct mm_struct *mm;
+	bool mm_users; /* We hold an mm_users reference, until vmas_stop() */
+	unsigned long next_addr; /* The next VMA is the first one above */
+	struct vma_record rec;
+};
+
+static struct vm_area_struct *first_vma_from(struct mm_struct *mm,
+					     unsigned long addr)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	VMA_ITERATOR(vmi, mm, addr);
+
+	return vma_find(&vmi, ULONG_MAX);
+#else
+	return find_vma(mm, addr);
+#endif
+}
+
+/* A walk of the page tables of a range of addresses, with mmap_lock
+ * held. walk_page_range() is not exported to modules, so we go down the
+ * levels ourselves, with the inline p?d_offset() helpers. pte_entry is
+ * called for every PTE of the range, present or not, under the lock of
+ * its page table, and pmd_entry for every transparent huge page, under
+ * pmd_lock(). hugetlbfs mappings are skipped.
+ */
+struct pt_walk {
+	struct vm_area_struct *vma; /* The VMA being walked */
+	void (*pte_entry)(struct pt_walk *walk, pte_t *pte,
+			  unsigned long addr);
+	void (*pmd_entry)(struct pt_walk *walk, pmd_t *pmd,
+			  unsigned long addr, unsigned long next);
+	void *private;
+};
+
+static void walk_pte_range(struct pt_walk *walk, pmd_t *pmd,
+			   unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = walk->vma->vm_mm;
+	pte_t *start_pte, *pte;
+	spinlock_t *ptl;
+
+	/* Since v6.5, NULL if the page table went away meanwhile. */
+	start_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	if (!pte)
+		return;
+	for (; addr < end; addr += PAGE_SIZE, pte++)
+		walk->pte_entry(walk, pte, addr);
+	pte_unmap_unlock(start_pte, ptl);
+}
+
+static void walk_pmd_range(struct pt_walk *walk, pud_t *pud,
+			   unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = walk->vma->vm_mm;
+	unsigned long next;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	pmd_t val;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		val = pmdp_get_lockless(pmd);
+		if (pmd_none(val))
+			continue;
+		if (pmd_trans_huge(val)) {
+			ptl = pmd_lock(mm, pmd);
+			if (pmd_trans_huge(*pmd)) {
+				walk->pmd_entry(walk, pmd, addr, next);
+				spin_unlock(ptl);
+				continue;
+			}
+			/* Split meanwhile; look again. */
+			spin_unlock(ptl);
+			val = pmdp_get_lockless(pmd);
+		}
+		if (pmd_none(val) || pmd_trans_huge(val) || pmd_bad(val))
+			continue;
+		walk_pte_range(walk, pmd, addr, next);
+	} while (pmd++, addr = next, addr != end);
+}
+
+static void walk_pud_range(struct pt_walk *walk, p4d_t *p4d,
+			   unsigned long addr, unsigned long end)
+{
+	unsigned long next;
+	pud_t *pud;
+
+	pud = pud_offset(p4d, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		/* pud_bad() also covers huge PUDs, which we skip. */
+		if (pud_none(*pud) || pud_bad(*pud))
+			continue;
+		walk_pmd_range(walk, pud, addr, next);
+	} while (pud++, addr = next, addr != end);
+}
+
+static void walk_p4d_range(struct pt_walk *walk, pgd_t *pgd,
+			   unsigned long addr, unsigned long end)
+{
+	unsigned long next;
+	p4d_t *p4d;
+
+	p4d = p4d_offset(pgd, addr);
+	do {
+		next = p4d_addr_end(addr, end);
+		if (p4d_none(*p4d) || p4d_bad(*p4d))
+			continue;
+		walk_pud_range(walk, p4d, addr, next);
+	} while (p4d++, addr = next, addr != end);
+}
+
+/* Walk whatever is mapped from @addr to @end, VMA by VMA. */
+static void walk_range(struct mm_struct *mm, unsigned long addr,
+		       unsigned long end, struct pt_walk *walk)
+{
+	struct vm_area_struct *vma;
+	unsigned long stop, next;
+	pgd_t *pgd;
+
+	while (addr < end) {
+		vma = first_vma_from(mm, addr);
+		if (!vma || vma->vm_start >= end)
+			return;
+		addr = max(addr, vma->vm_start);
+		stop = min(end, vma->vm_end);
+		if (!is_vm_hugetlb_page(vma)) {
+			walk->vma = vma;
+			pgd = pgd_offset(mm, addr);
+			do {
+				next = pgd_addr_end(addr, stop);
+				if (pgd_none(*pgd) || pgd_bad(*pgd))
+					continue;
+				walk_p4d_range(walk, pgd, addr, next);
+			} while (pgd++, addr = next, addr != stop);
+		}
+		addr = stop;
+	}
+}
+
+static void count_pte(struct pt_walk *walk, pte_t *pte, unsigned long addr)
+{
+	struct vma_record *rec = walk->private;
+	pte_t ptent = ptep_get(pte);
+
+	if (pte_present(ptent)) {
+		rec->rss += PAGE_SIZE;
+	} else if (is_swap_pte(ptent)) {
+		swp_entry_t entry = pte_to_swp_entry(ptent);
+
+		if (!non_swap_entry(entry))
+			rec->swap += PAGE_SIZE;
+	}
+}
+
+/* Transparent huge pages count whole. */
+static void count_pmd(struct pt_walk *walk, pmd_t *pmd, unsigned long addr,
+		      unsigned long next)
+{
+	struct vma_record *rec = walk->private;
+
+	rec->rss += next - addr;
+}
+
+static void vma_name(struct mm_struct *mm, struct vm_area_struct *vma,
+		     char *name, size_t size)
+{
+	if (vma->vm_file)
+		snprintf(name, size, "%pD", vma->vm_file);
+	else if (vma->vm_start <= mm->brk && vma->vm_end >= mm->start_brk)
+		strscpy(name, "[heap]", size);
+	else if (vma->vm_start <= mm->start_stack &&
+		 vma->vm_end >= mm->start_stack)
+		strscpy(name, "[stack]", size);
+	else
+		strscpy(name, "[anon]", size);
+}
+
+/* Find the first VMA above ins->next_addr, and account its pages, one
+ * SCAN_CHUNK at a time. The VMA may change or go away whenever we drop
+ * mmap_lock: we then count whatever is mapped at the addresses it had.
+ */
+static int load_vma(struct vma_inspector *ins)
+{
+	struct vma_record *rec = &ins->rec;
+	struct mm_struct *mm = ins->mm;
+	struct pt_walk walk = {
+		.pte_entry = count_pte,
+		.pmd_entry = count_pmd,
+		.private = rec,
+	};
+	struct vm_area_struct *vma;
+	unsigned long addr, end;
+
+	if (mmap_read_lock_killable(mm))
+		return -EINTR;
+	vma = first_vma_from(mm, ins->next_addr);
+	if (!vma) {
+		mmap_read_unlock(mm);
+		return -ENOENT;
+	}
+	rec->start = vma->vm_start;
+	rec->end = vma->vm_end;
+	rec->rss = rec->swap = 0;
+	vma_name(mm, vma, rec->name, sizeof(rec->name));
+	mmap_read_unlock(mm);
+
+	for (addr = rec->start; addr < rec->end; addr = end) {
+		end = min(rec->end, ALIGN(addr + 1, SCAN_CHUNK));
+		if (mmap_read_lock_killable(mm))
+			return -EINTR;
+		walk_range(mm, addr, end, &walk);
+		mmap_read_unlock(mm);
+		cond_resched();
+	}
+	return 0;
+}
+
+/* The position is only used to restart from the first VMA; otherwise
+ * we resume from the address where the last record ended, so that
+ * mmap_lock is never held across calls.
+ */
+static void *vmas_load(struct vma_inspector *ins, loff_t *pos)
+{
+	int ret;
+
+	if (*pos == 0) {
+		ins->next_addr = 0;
+		return SEQ_START_TOKEN;
+	}
+	ret = load_vma(ins);
+	return ret ? (ret == -ENOENT ? NULL : ERR_PTR(ret)) : &ins->rec;
+}
+
+static void *vmas_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct vma_inspector *ins = m->private;
+
+	if (v != SEQ_START_TOKEN)
+		ins->next_addr = ins->rec.end;
+	(*pos)++;
+	return vmas_load(ins, pos);
+}
+
+/* As /proc/<pid>/maps does, the open file only keeps the mm_struct; its
+ * address space is only pinned for the duration of a read(), so that an
+ * open file does not keep the memory of a dead process.
+ */
+static void *vmas_start(struct seq_file *m, loff_t *pos)
+{
+	struct vma_inspector *ins = m->private;
+
+	if (!mmget_not_zero(ins->mm))
+		return NULL;
+	ins->mm_users = true;
+	return vmas_load(ins, pos);
+}
+
+static void vmas_stop(struct seq_file *m, void *v)
+{
+	struct vma_inspector *ins = m->private;
+
+	if (ins->mm_users) {
+		mmput(ins->mm);
+		ins->mm_users = false;
+	}
+}
+
+static int vmas_show(struct seq_file *m, void *v)
+{
+	const struct vma_record *rec = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "# start-end size_kb rss_kb swap_kb name\n");
+		return 0;
+	}
+	seq_printf(m, "%lx-%lx %lu %lu %lu %s\n", rec->start, rec->end,
+		   (rec->end - rec->start) >> 10, rec->rss >> 10,
+		   rec->swap >> 10, rec->name);
+	return 0;
+}
+
+static const struct seq_operations vmas_seq_ops = {
+	.start = vmas_start,
+	.next = vmas_next,
+	.stop = vmas_stop,
+	.show = vmas_show,
+};
+
+/* The mm of the process given by the pid parameter, or NULL. */
+static struct mm_struct *target_mm(int nr)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+	struct pid *vpid;
+
+	vpid = find_get_pid(nr);
+	task = get_pid_task(vpid, PIDTYPE_PID);
+	put_pid(vpid);
+	if (!task)
+		return NULL;
+	mm = get_task_mm(task);
+	put_task_struct(task);
+	return mm;
+}
+
+static int vmas_open(struct inode *inode, struct file *file)
+{
+	struct vma_inspector *ins;
+	struct mm_struct *mm;
+	int ret;
+
+	mm = target_mm(READ_ONCE(pid));
+	if (!mm)
+		return -ESRCH;
+	mmgrab(mm);
+	mmput(mm);
+
+	ret = seq_open_private(file, &vmas_seq_ops, sizeof(*ins));
+	if (ret) {
+		mmdrop(mm);
+		return ret;
+	}
+	ins = ((struct seq_file *)file->private_data)->private;
+	ins->mm = mm;
+	return 0;
+}
+
+static int vmas_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+	struct vma_inspector *ins = m->private;
+
+	mmdrop(ins->mm);
+	return seq_release_private(inode, file);
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops vmas_fops = {
+	.proc_open = vmas_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = vmas_release,
+};
+#else
+static const struct file_operations vmas_fops = {
+	.open = vmas_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = vmas_release,
+};
+#endif
+
+/* The last snapshot of an open /proc/pid_info_tasks, kept to compute
+ * the next delta, and what read() returns.
+ */
+struct task_reader {
+	struct mutex lock;
+	u64 generation;
+	struct pid_info_task *prev;
+	size_t nr_prev;
+	void *out;
+	size_t out_len;
+	size_t out_read;
+};
+
+static atomic64_t snapshot_generation;
+/* How many tasks the last snapshot had room for. */
+static size_t task_capacity = 256;
+
+static void fill_task(struct pid_info_task *rec, struct task_struct *task,
+		      struct pid_namespace *ns, struct pid *tpid)
+{
+	struct mm_struct *mm;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->pid = pid_nr_ns(tpid, ns);
+	rec->tgid = task_tgid_nr_ns(task, ns);
+	rec->level = tpid->level;
+	rec->state = task_index_to_char(task_state_index(task));
+	rec->utime_ns = task->utime;
+	rec->stime_ns = task->stime;
+	get_task_comm(rec->comm, task);
+
+	/* task_lock() keeps task->mm from being released under us. */
+	task_lock(task);
+	mm = task->mm;
+	if (mm)
+		rec->rss_bytes = (u64)get_mm_rss(mm) << PAGE_SHIFT;
+	task_unlock(task);
+}
+
+/* Gather all the tasks of @ns in one RCU traversal. We cannot allocate
+ * within it, so when there turn out to be more tasks than room, we
+ * retry with a larger array.
+ */
+static struct pid_info_task *collect_tasks(struct pid_namespace *ns,
+					   size_t *nr_tasks)
+{
+	size_t cap = READ_ONCE(task_capacity), n;
+	struct task_struct *g, *t;
+	struct pid_info_task *recs;
+
+	for (;;) {
+		recs = kvmalloc_array(cap, sizeof(*recs), GFP_KERNEL);
+		if (!recs)
+			return NULL;
+
+		n = 0;
+		rcu_read_lock();
+		for_each_process_thread(g, t) {
+			struct pid *tpid = task_pid(t);
+
+			/* Exiting, or not visible from @ns */
+			if (!tpid || !pid_nr_ns(tpid, ns))
+				continue;
+			if (n < cap)
+				fill_task(&recs[n], t, ns, tpid);
+			n++;
+		}
+		rcu_read_unlock();
+
+		if (n <= cap)
+			break;
+		kvfree(recs);
+		cap = n + n / 4 + 16;
+	}
+
+	WRITE_ONCE(task_capacity, cap);
+	*nr_tasks = n;
+	return recs;
+}
+
+static int task_cmp(const void *a, const void *b)
+{
+	pid_t x = ((const struct pid_info_task *)a)->pid;
+	pid_t y = ((const struct pid_info_task *)b)->pid;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Take a snapshot into reader->out: all the tasks, or, if @cookie is the
+ * generation of the previous one, those which differ from it.
+ */
+static int take_snapshot(struct task_reader *reader, u64 cookie)
+{
+	bool delta = cookie && cookie == reader->generation;
+	struct pid_info_snapshot *hdr;
+	struct pid_info_task *recs, *out;
+	size_t nr, i = 0, j = 0, n = 0;
+	size_t max_out;
+
+	recs = collect_tasks(task_active_pid_ns(current), &nr);
+	if (!recs)
+		return -ENOMEM;
+	sort(recs, nr, sizeof(*recs), task_cmp, NULL);
+
+	/* At worst, every previous task exited and every task is new. */
+	max_out = nr + (delta ? reader->nr_prev : 0);
+	hdr = kvmalloc(sizeof(*hdr) + max_out * sizeof(*out), GFP_KERNEL);
+	if (!hdr) {
+		kvfree(recs);
+		return -ENOMEM;
+	}
+	out = (struct pid_info_task *)(hdr + 1);
+
+	if (!delta) {
+		memcpy(out, recs, nr * sizeof(*out));
+		n = nr;
+	} else {
+		/* Both arrays are sorted by pid: merge them. */
+		while (i < nr || j < reader->nr_prev) {
+			const struct pid_info_task *cur, *old;
+
+			cur = i < nr ? &recs[i] : NULL;
+			old = j < reader->nr_prev ? &reader->prev[j] : NULL;
+
+			if (cur && (!old || cur->pid < old->pid)) {
+				out[n++] = *cur;
+				i++;
+			} else if (!cur || old->pid < cur->pid) {
+				out[n] = *old;
+				out[n++].flags = PID_INFO_TASK_EXITED;
+				j++;
+			} else {
+				if (memcmp(cur, old, sizeof(*cur)))
+					out[n++] = *cur;
+				i++;
+				j++;
+			}
+		}
+	}
+
+	hdr->generation = atomic64_inc_return(&snapshot_generation);
+	hdr->flags = delta ? PID_INFO_SNAPSHOT_DELTA : 0;
+	hdr->nr_tasks = n;
+	hdr->task_size = sizeof(*out);
+	hdr->pad = 0;
+
+	kvfree(reader->prev);
+	reader->prev = recs;
+	reader->nr_prev = nr;
+	reader->generation = hdr->generation;
+	kvfree(reader->out);
+	reader->out = hdr;
+	reader->out_len = sizeof(*hdr) + n * sizeof(*out);
+	reader->out_read = 0;
+	return 0;
+}
+
+static ssize_t tasks_write(struct file *file, const char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	struct task_reader *reader = file->private_data;
+	u64 cookie;
+	int ret;
+
+	if (count != sizeof(cookie))
+		return -EINVAL;
+	if (copy_from_user(&cookie, buf, sizeof(cookie)))
+		return -EFAULT;
+
+	mutex_lock(&reader->lock);
+	ret = take_snapshot(reader, cookie);
+	mutex_unlock(&reader->lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t tasks_read(struct file *file, char __user *buf, size_t count,
+			  loff_t *ppos)
+{
+	struct task_reader *reader = file->private_data;
+	ssize_t ret = 0;
+
+	mutex_lock(&reader->lock);
+	if (!reader->out)
+		ret = take_snapshot(reader, 0);
+	if (!ret) {
+		count = min(count, reader->out_len - reader->out_read);
+		if (copy_to_user(buf, reader->out + reader->out_read, count)) {
+			ret = -EFAULT;
+		} else {
+			reader->out_read += count;
+			ret = count;
+		}
+	}
+	mutex_unlock(&reader->lock);
+
+	return ret;
+}
+
+static int tasks_open(struct inode *inode, struct file *file)
+{
+	struct task_reader *reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+
+	if (!reader)
+		return -ENOMEM;
+	mutex_init(&reader->lock);
+	file->private_data = reader;
+	return stream_open(inode, file);
+}
+
+static int tasks_release(struct inode *inode, struct file *file)
+{
+	struct task_reader *reader = file->private_data;
+
+	kvfree(reader->prev);
+	kvfree(reader->out);
+	kfree(reader);
+	return 0;
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops tasks_fops = {
+	.proc_open = tasks_open,
+	.proc_read = tasks_read,
+	.proc_write = tasks_write,
+	.proc_release = tasks_release,
+};
+#else
+static const struct file_operations tasks_fops = {
+	.open = tasks_open,
+	.read = tasks_read,
+	.write = tasks_write,
+	.release = tasks_release,
+};
+#endif
+
+/* The working set of the process given by the pid parameter, with
+ * wss_window_ms set: its pages are scanned over and over, and each scan
+ * tests and clears their accessed bits. A page found accessed was used
+ * since the previous scan of it, one window earlier, so the pages found
+ * accessed in a scan are the working set of a window.
+ *
+ * A scan is incremental: every wss_tick_ms, it goes on from where it
+ * stopped for at most wss_pages_per_tick pages of address space, under
+ * one hold of mmap_lock. When it is over, it waits for the end of the
+ * window, publishes what it found in /proc/pid_info_wss, and the next
+ * scan starts; the window is longer when a scan takes longer than it.
+ */
+
+#define WSS_PROC_NAME "pid_info_wss"
+
+static unsigned int wss_window_ms;
+module_param(wss_window_ms, uint, 0444);
+MODULE_PARM_DESC(wss_window_ms,
+		 "Window of the working-set estimate in ms, 0 to disable.");
+
+static unsigned int wss_tick_ms = 10;
+module_param(wss_tick_ms, uint, 0644);
+MODULE_PARM_DESC(wss_tick_ms,
+		 "Interval of the scan steps in ms (default: 10).");
+
+static unsigned int wss_pages_per_tick = 4096;
+module_param(wss_pages_per_tick, uint, 0644);
+MODULE_PARM_DESC(wss_pages_per_tick,
+		 "Pages of address space per scan step (default: 4096).");
+
+struct wss_vma {
+	unsigned long start, end;
+	unsigned long rss, young; /* In bytes */
+	char name[64];
+};
+
+struct wss_scan {
+	u64 window_ns;
+	int pid;
+	unsigned int nr, cap;
+	struct wss_vma vmas[];
+};
+
+/* The scan in progress, only touched by wss_work. */
+static struct mm_struct *wss_mm;
+static struct wss_scan *wss_cur;
+static unsigned long wss_addr; /* Where the next step resumes */
+static u64 wss_start_ns;
+static int wss_last_pid;
+static bool wss_first; /* The accessed bits were never cleared */
+
+/* The last complete scan, under wss_lock. */
+static struct wss_scan *wss_last;
+static DEFINE_MUTEX(wss_lock);
+
+static void wss_tick(struct work_struct *work);
+static DECLARE_DELAYED_WORK(wss_work, wss_tick);
+
+/* Page reclaim uses ptep_test_and_clear_young(), which x86 does not
+ * export; there, it is an atomic clear of the accessed bit. As in
+ * reclaim, the TLB is not flushed: a page whose translation stays cached
+ * may be seen as idle, which undercounts a little.
+ */
+#ifdef CONFIG_X86
+static bool clear_young_pte(struct vm_area_struct *vma, unsigned long addr,
+			    pte_t *pte)
+{
+	return pte_young(ptep_get(pte)) &&
+	       test_and_clear_bit(_PAGE_BIT_ACCESSED, (unsigned long *)pte);
+}
+
+static bool clear_young_pmd(struct vm_area_struct *vma, unsigned long addr,
+			    pmd_t *pmd)
+{
+	return pmd_young(*pmd) &&
+	       test_and_clear_bit(_PAGE_BIT_ACCESSED, (unsigned long *)pmd);
+}
+#else
+#define clear_young_pte ptep_test_and_clear_young
+#define clear_young_pmd pmdp_test_and_clear_young
+#endif
+
+/* Reclaim, and MGLRU, take a page whose accessed bit is clear for a
+ * cold one: once we have cleared it, we must tell them that the page was
+ * used, or every scan would get hot pages of the process evicted. As in
+ * mm/page_idle.c, the young flag of the page does that, which
+ * folio_referenced() tests and clears. Without CONFIG_PAGE_IDLE_FLAG,
+ * there is no such flag, which my_init() warns about.
+ */
+static void wss_mark_young(struct page *page)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+	struct folio *folio = page_folio(page);
+
+	folio_clear_idle(folio);
+	folio_set_young(folio);
+#else
+	clear_page_idle(page);
+	set_page_young(page);
+#endif
+}
+
+static void wss_pte(struct pt_walk *walk, pte_t *pte, unsigned long addr)
+{
+	struct wss_vma *rec = walk->private;
+	pte_t ptent = ptep_get(pte);
+
+	if (pte_present(ptent)) {
+		rec->rss += PAGE_SIZE;
+		if (clear_young_pte(walk->vma, addr, pte)) {
+			rec->young += PAGE_SIZE;
+			/* Raw PFN mappings have no struct page to mark. */
+			if (!pte_special(ptent) && pfn_valid(pte_pfn(ptent)))
+				wss_mark_young(pte_page(ptent));
+		}
+	}
+}
+
+/* Called under pmd_lock(), for transparent huge pages only. */
+static void wss_pmd(struct pt_walk *walk, pmd_t *pmd, unsigned long addr,
+		    unsigned long next)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	struct wss_vma *rec = walk->private;
+
+	rec->rss += next - addr;
+	if (clear_young_pmd(walk->vma, addr, pmd)) {
+		rec->young += next - addr;
+		wss_mark_young(pmd_page(*pmd));
+	}
+#endif
+}
+
+/* The record of @vma in the current scan, which is the last one unless
+ * we just got to @vma.
+ */
+static struct wss_vma *wss_record(struct vm_area_struct *vma)
+{
+	struct wss_scan *scan = wss_cur, *bigger;
+	struct wss_vma *rec;
+
+	if (scan->nr && scan->vmas[scan->nr - 1].start == vma->vm_start)
+		return &scan->vmas[scan->nr - 1];
+	if (scan->nr == scan->cap) {
+		bigger = kvmalloc(struct_size(bigger, vmas, 2 * scan->cap),
+				  GFP_KERNEL);
+		if (!bigger)
+			return NULL;
+		memcpy(bigger, scan, struct_size(scan, vmas, scan->nr));
+		bigger->cap = 2 * scan->cap;
+		kvfree(scan);
+		wss_cur = scan = bigger;
+	}
+	rec = &scan->vmas[scan->nr++];
+	rec->start = vma->vm_start;
+	rec->end = vma->vm_end;
+	rec->rss = rec->young = 0;
+	vma_name(wss_mm, vma, rec->name, sizeof(rec->name));
+	return rec;
+}
+
+static int wss_start_scan(u64 now)
+{
+	int nr = READ_ONCE(pid);
+
+	wss_cur = kvmalloc(struct_size(wss_cur, vmas, 64), GFP_KERNEL);
+	if (!wss_cur)
+		return -ENOMEM;
+	wss_mm = target_mm(nr);
+	if (!wss_mm) {
+		kvfree(wss_cur);
+		wss_cur = NULL;
+		return -ESRCH;
+	}
+	wss_cur->pid = nr;
+	wss_cur->nr = 0;
+	wss_cur->cap = 64;
+	wss_first = nr != wss_last_pid;
+	wss_last_pid = nr;
+	wss_addr = 0;
+	wss_start_ns = now;
+	return 0;
+}
+
+/* The first scan of a process only clears the bits, which have been
+ * set since the pages were faulted in, so there is nothing to publish.
+ */
+static void wss_end_scan(u64 now)
+{
+	wss_cur->window_ns = now - wss_start_ns;
+	if (!wss_first) {
+		mutex_lock(&wss_lock);
+		swap(wss_last, wss_cur);
+		mutex_unlock(&wss_lock);
+	}
+	kvfree(wss_cur);
+	wss_cur = NULL;
+	mmput(wss_mm);
+	wss_mm = NULL;
+}
+
+/* One step of the scan. The budget is in pages of address space, mapped
+ * or not, but the holes between VMAs are skipped for free.
+ */
+static void wss_tick(struct work_struct *work)
+{
+	unsigned long budget = max(wss_pages_per_tick, 1U);
+	u64 window_ns = (u64)wss_window_ms * NSEC_PER_MSEC;
+	/* At least one jiffy, or a tick of 0 would never let go of the CPU. */
+	unsigned long delay = max(msecs_to_jiffies(wss_tick_ms), 1UL);
+	struct pt_walk walk = {
+		.pte_entry = wss_pte,
+		.pmd_entry = wss_pmd,
+	};
+	unsigned long start, end;
+	struct vm_area_struct *vma;
+	struct wss_vma *rec;
+	u64 now = ktime_get_ns();
+
+	if (!wss_mm && wss_start_scan(now))
+		goto out;
+
+	if (wss_addr != ULONG_MAX) {
+		mmap_read_lock(wss_mm);
+		while (budget) {
+			vma = first_vma_from(wss_mm, wss_addr);
+			if (!vma) {
+				wss_addr = ULONG_MAX;
+				break;
+			}
+			rec = wss_record(vma);
+			if (!rec)
+				break;
+			start = max(wss_addr, vma->vm_start);
+			end = min(vma->vm_end, start + budget * PAGE_SIZE);
+			walk.private = rec;
+			walk_range(wss_mm, start, end, &walk);
+			budget -= (end - start) >> PAGE_SHIFT;
+			wss_addr = end;
+		}
+		mmap_read_unlock(wss_mm);
+	}
+
+	if (wss_addr == ULONG_MAX) {
+		now = ktime_get_ns();
+		if (now - wss_start_ns >= window_ns)
+			wss_end_scan(now);
+		else
+			delay = nsecs_to_jiffies(wss_start_ns + window_ns - now);
+	}
+out:
+	schedule_delayed_work(&wss_work, delay);
+}
+
+static int wss_show(struct seq_file *m, void *v)
+{
+	const struct wss_scan *scan = m->private;
+	unsigned int i;
+
+	seq_printf(m, "# pid %d window_ns %llu\n", scan->pid, scan->window_ns);
+	seq_puts(m, "# start-end size_kb rss_kb wss_kb name\n");
+	for (i = 0; i < scan->nr; i++) {
+		const struct wss_vma *rec = &scan->vmas[i];
+
+		seq_printf(m, "%lx-%lx %lu %lu %lu %s\n", rec->start, rec->end,
+			   (rec->end - rec->start) >> 10, rec->rss >> 10,
+			   rec->young >> 10, rec->name);
+	}
+	return 0;
+}
+
+static int wss_open(struct inode *inode, struct file *file)
+{
+	struct wss_scan *scan;
+	int ret;
+
+	mutex_lock(&wss_lock);
+	if (wss_last) {
+		size_t size = struct_size(wss_last, vmas, wss_last->nr);
+
+		scan = kvmalloc(size, GFP_KERNEL);
+		if (scan)
+			memcpy(scan, wss_last, size);
+	} else {
+		/* The first window is not over yet. */
+		scan = kvzalloc(sizeof(*scan), GFP_KERNEL);
+	}
+	mutex_unlock(&wss_lock);
+	if (!scan)
+		return -ENOMEM;
+
+	ret = single_open(file, wss_show, scan);
+	if (ret)
+		kvfree(scan);
+	return ret;
+}
+
+static int wss_release(struct inode *inode, struct file *file)
+{
+	kvfree(((struct seq_file *)file->private_data)->private);
+	return single_release(inode, file);
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops wss_fops = {
+	.proc_open = wss_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = wss_release,
+};
+#else
+static const struct file_operations wss_fops = {
+	.open = wss_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = wss_release,
+};
+#endif
+
 static int __init my_init(void)
 {
 	unsigned int level;
@@ -30,11 +1139,45 @@ static int __init my_init(void)
 		rcu_read_unlock();
 		pr_info("%s: vpid->level: %u\n", MODULE_NAME, level);
 	}
+
+	if (!proc_create(PID_INFO_PROC_NAME, 0600, NULL, &batch_fops))
+		return -ENOMEM;
+	if (!proc_create(VMAS_PROC_NAME, 0400, NULL, &vmas_fops))
+		goto remove_batch;
+	if (!proc_create(PID_INFO_TASKS_PROC_NAME, 0600, NULL, &tasks_fops))
+		goto remove_vmas;
+	if (wss_window_ms) {
+		if (!IS_ENABLED(CONFIG_PAGE_IDLE_FLAG))
+			pr_warn("%s: without CONFIG_PAGE_IDLE_FLAG, the scan makes reclaim take the pages of process %d for idle\n",
+				MODULE_NAME, pid);
+		if (!proc_create(WSS_PROC_NAME, 0400, NULL, &wss_fops))
+			goto remove_tasks;
+		schedule_delayed_work(&wss_work, 0);
+	}
 	return 0;
+
+remove_tasks:
+	remove_proc_entry(PID_INFO_TASKS_PROC_NAME, NULL);
+remove_vmas:
+	remove_proc_entry(VMAS_PROC_NAME, NULL);
+remove_batch:
+	remove_proc_entry(PID_INFO_PROC_NAME, NULL);
+	return -ENOMEM;
 }
 
 static void __exit my_exit(void)
 {
+	if (wss_window_ms) {
+		remove_proc_entry(WSS_PROC_NAME, NULL);
+		cancel_delayed_work_sync(&wss_work);
+		if (wss_mm)
+			mmput(wss_mm);
+		kvfree(wss_cur);
+		kvfree(wss_last);
+	}
+	remove_proc_entry(PID_INFO_TASKS_PROC_NAME, NULL);
+	remove_proc_entry(VMAS_PROC_NAME, NULL);
+	remove_proc_entry(PID_INFO_PROC_NAME, NULL);
 	pr_info("%s: Goodbye world.\n", MODULE_NAME);
 }
 
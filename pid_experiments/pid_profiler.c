@@ -0,0 +1,311 @@
+/*
+ * pid_profiler.c
+ *
+ * A sampling profiler for one process, without perf.
+ *
+ * Every CPU runs an hrtimer at freq Hz. When it fires while a thread of
+ * the target process is running on that CPU, the interrupted stack is
+ * sampled: with mode=stack, its kernel frames, if it was in the kernel,
+ * then its user frames, found by following the frame pointers; with
+ * mode=ip, only the interrupted instruction. Samples go to rings, one
+ * per CPU, which /dev/pid_profiler maps; see include/pid_profiler.h and
+ * userspace/profile.c, which prints them folded, for flame graphs.
+ *
+ * A ring is only written by the timer interrupt of its CPU, so it has a
+ * single producer, and needs no lock.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/device.h> /* For class_create() */
+#include <linux/fs.h> /* For register_chrdev() */
+#include <linux/hrtimer.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/pid.h>
+#include <linux/poll.h>
+#include <linux/ptrace.h>
+#include <linux/sched.h>
+#include <linux/sched/task_stack.h> /* For task_pt_regs() */
+#include <linux/smp.h>
+#include <linux/stacktrace.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include <asm/irq_regs.h> /* For get_irq_regs() */
+
+#include <pid_profiler.h>
+
+#define MODULE_NAME "pid_profiler"
+
+static int pid;
+module_param(pid, int, 0444);
+MODULE_PARM_DESC(pid, "The process to profile.");
+
+static unsigned int freq = 99;
+module_param(freq, uint, 0444);
+MODULE_PARM_DESC(freq, "Samples per second and CPU (default: 99).");
+
+static char *mode = "stack";
+module_param(mode, charp, 0444);
+MODULE_PARM_DESC(mode, "What to sample: \"stack\" or \"ip\".");
+
+static unsigned int ring_size = 4096;
+module_param(ring_size, uint, 0444);
+MODULE_PARM_DESC(ring_size, "Samples per CPU ring (default: 4096).");
+
+static struct pid *target;
+static bool stacks;
+static ktime_t period;
+static DEFINE_PER_CPU(struct hrtimer, sample_timer);
+/* The CPUs whose timer was set up */
+static struct cpumask started;
+
+static void *rings;
+static unsigned int ring_bytes;
+static int major;
+static struct class *cls;
+static DECLARE_WAIT_QUEUE_HEAD(sample_wait);
+
+static struct profiler_ring_header *ring_header(int cpu)
+{
+	return rings + (size_t)cpu * ring_bytes;
+}
+
+/* The headers are mapped writable, so mask with our own ring_size. */
+static struct profiler_sample *ring_slot(struct profiler_ring_header *hdr,
+					 u64 pos)
+{
+	struct profiler_sample *samples = (void *)hdr + PAGE_SIZE;
+
+	return &samples[pos & (ring_size - 1)];
+}
+
+/* Follow the frame pointers of the user stack. Frames are laid out as
+ * { previous frame pointer, return address } on x86-64 and arm64; a
+ * program built without frame pointers gives its innermost frame only.
+ * We are in an interrupt, so the stack must be read without faulting.
+ */
+static unsigned int user_stack(struct pt_regs *regs, u64 *ips,
+			       unsigned int max)
+{
+	unsigned long fp = frame_pointer(regs);
+	unsigned int n = 0;
+
+	ips[n++] = instruction_pointer(regs);
+	while (n < max && fp && !(fp & (sizeof(long) - 1))) {
+		unsigned long frame[2];
+
+		if (copy_from_user_nofault(frame, (void __user *)fp,
+					   sizeof(frame)))
+			break;
+		if (!frame[1])
+			break;
+		ips[n++] = frame[1];
+		/* The stack grows down, so callers are above. */
+		if (frame[0] <= fp)
+			break;
+		fp = frame[0];
+	}
+	return n;
+}
+
+/* Save the interrupted kernel stack. stack_trace_save() starts from
+ * here, so skip the frames of the interrupt itself, up to the
+ * interrupted instruction.
+ */
+static unsigned int kernel_stack(struct pt_regs *regs, u64 *ips,
+				 unsigned int max)
+{
+	unsigned long entries[PROFILER_MAX_DEPTH];
+	unsigned int n, i, skip = 0;
+
+	n = stack_trace_save(entries, ARRAY_SIZE(entries), 0);
+	for (i = 0; i < n; i++) {
+		if (entries[i] == instruction_pointer(regs)) {
+			skip = i;
+			break;
+		}
+	}
+	for (i = skip; i < n && i - skip < max; i++)
+		ips[i - skip] = entries[i];
+	return i - skip;
+}
+
+static void take_sample(struct pt_regs *regs)
+{
+	struct profiler_ring_header *hdr = ring_header(smp_processor_id());
+	struct profiler_sample *sample;
+	unsigned int nr_kernel = 0;
+	u64 head;
+
+	head = READ_ONCE(hdr->head);
+	if (head - smp_load_acquire(&hdr->tail) >= ring_size) {
+		hdr->dropped++;
+		return;
+	}
+
+	sample = ring_slot(hdr, head);
+	sample->ts = ktime_get_ns();
+	sample->tid = task_pid_nr(current);
+	if (!stacks) {
+		sample->ips[0] = instruction_pointer(regs);
+		sample->nr_kernel = !user_mode(regs);
+		sample->nr_user = user_mode(regs);
+	} else {
+		if (!user_mode(regs)) {
+			nr_kernel = kernel_stack(regs, sample->ips,
+						 PROFILER_MAX_DEPTH);
+			/* Kernel threads have no user stack. */
+			regs = current->mm ? task_pt_regs(current) : NULL;
+		}
+		sample->nr_kernel = nr_kernel;
+		sample->nr_user = 0;
+		if (regs)
+			sample->nr_user =
+				user_stack(regs, sample->ips + nr_kernel,
+					   PROFILER_MAX_DEPTH - nr_kernel);
+	}
+	smp_store_release(&hdr->head, head + 1);
+}
+
+static enum hrtimer_restart sample_tick(struct hrtimer *timer)
+{
+	struct pt_regs *regs = get_irq_regs();
+
+	if (regs && task_tgid(current) == target) {
+		take_sample(regs);
+		if (wq_has_sleeper(&sample_wait))
+			wake_up_interruptible(&sample_wait);
+	}
+
+	hrtimer_forward_now(timer, period);
+	return HRTIMER_RESTART;
+}
+
+/* Run on each CPU, so that its timer is pinned there. */
+static void start_timer(void *unused)
+{
+	struct hrtimer *timer = this_cpu_ptr(&sample_timer);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(timer, sample_tick, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_PINNED_HARD);
+#else
+	hrtimer_init(timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED_HARD);
+	timer->function = sample_tick;
+#endif
+	hrtimer_start(timer, period, HRTIMER_MODE_REL_PINNED_HARD);
+	cpumask_set_cpu(smp_processor_id(), &started);
+}
+
+static bool rings_empty(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct profiler_ring_header *hdr = ring_header(cpu);
+
+		if (smp_load_acquire(&hdr->head) != READ_ONCE(hdr->tail))
+			return false;
+	}
+	return true;
+}
+
+static __poll_t profiler_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &sample_wait, wait);
+	return rings_empty() ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+/* Map all the rings. The consumer advances tail itself. */
+static int profiler_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return remap_vmalloc_range(vma, rings, vma->vm_pgoff);
+}
+
+static struct file_operations profiler_fops = {
+	.owner = THIS_MODULE,
+	.poll = profiler_poll,
+	.mmap = profiler_mmap,
+	.llseek = noop_llseek,
+};
+
+static int __init profiler_init(void)
+{
+	int cpu;
+
+	if (!freq || freq > NSEC_PER_SEC)
+		return -EINVAL;
+	if (!strcmp(mode, "stack"))
+		stacks = true;
+	else if (strcmp(mode, "ip"))
+		return -EINVAL;
+	period = ns_to_ktime(NSEC_PER_SEC / freq);
+
+	target = find_get_pid(pid);
+	if (!target) {
+		pr_info("%s: no process %d\n", MODULE_NAME, pid);
+		return -ESRCH;
+	}
+
+	ring_size = roundup_pow_of_two(max(ring_size, 1U));
+	ring_bytes = PAGE_ALIGN(PAGE_SIZE +
+				ring_size * sizeof(struct profiler_sample));
+	/* Zeroed, and suitable for remap_vmalloc_range(). */
+	rings = vmalloc_user((size_t)nr_cpu_ids * ring_bytes);
+	if (!rings) {
+		put_pid(target);
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu) {
+		struct profiler_ring_header *hdr = ring_header(cpu);
+
+		hdr->nr_slots = ring_size;
+		hdr->sample_size = sizeof(struct profiler_sample);
+		hdr->nr_rings = nr_cpu_ids;
+		hdr->ring_bytes = ring_bytes;
+	}
+
+	major = register_chrdev(0, PROFILER_DEVICE_NAME, &profiler_fops);
+	if (major < 0) {
+		vfree(rings);
+		put_pid(target);
+		return major;
+	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	cls = class_create(PROFILER_DEVICE_NAME);
+#else
+	cls = class_create(THIS_MODULE, PROFILER_DEVICE_NAME);
+#endif
+	device_create(cls, NULL, MKDEV(major, 0), NULL, PROFILER_DEVICE_NAME);
+
+	/* CPUs brought online later are not sampled. */
+	on_each_cpu(start_timer, NULL, 1);
+	pr_info("%s: sampling process %d at %u Hz\n", MODULE_NAME, pid, freq);
+	return 0;
+}
+
+static void __exit profiler_exit(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &started)
+		hrtimer_cancel(per_cpu_ptr(&sample_timer, cpu));
+
+	device_destroy(cls, MKDEV(major, 0));
+	class_destroy(cls);
+	unregister_chrdev(major, PROFILER_DEVICE_NAME);
+	vfree(rings);
+	put_pid(target);
+}
+
+module_init(profiler_init);
+module_exit(profiler_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,119 @@
+/*  profile.c - fold the samples of pid_profiler for flame graphs
+ *
+ *  Maps the per-CPU rings of /dev/pid_profiler, and prints each sample
+ *  as a folded stack, outermost frame first, with a count of 1:
+ *
+ *      1234;0x55d0c8a01139;0x55d0c8a01210;0xffffffff9a2b3c4d_[k] 1
+ *
+ *  Kernel frames have the _[k] suffix which flamegraph.pl colors. Run
+ *  until interrupted, then merge the identical stacks, e.g.:
+ *
+ *      ./profile > samples; sort samples | uniq -c |
+ *          awk '{ print $2, $1 }' | flamegraph.pl > profile.svg
+ *
+ *  Addresses are left for addr2line or /proc/kallsyms to resolve.
+ */
+
+#include <pid_profiler.h>
+
+#include <fcntl.h> /* open */
+#include <poll.h> /* poll */
+#include <signal.h> /* signal */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit */
+#include <sys/mman.h> /* mmap */
+#include <unistd.h> /* close */
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void print_sample(const struct profiler_sample *s)
+{
+	int i;
+
+	printf("%u", s->tid);
+	for (i = s->nr_kernel + s->nr_user - 1; i >= s->nr_kernel; i--)
+		printf(";%#llx", (unsigned long long)s->ips[i]);
+	for (i = s->nr_kernel - 1; i >= 0; i--)
+		printf(";%#llx_[k]", (unsigned long long)s->ips[i]);
+	printf(" 1\n");
+}
+
+/* Print the pending samples of one ring, then hand their slots back. */
+static int drain(struct profiler_ring_header *hdr, long page_size)
+{
+	const struct profiler_sample *samples =
+		(const void *)((char *)hdr + page_size);
+	__u64 head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	__u64 tail = hdr->tail;
+	int n = 0;
+
+	for (; tail != head; tail++, n++)
+		print_sample(&samples[tail & (hdr->nr_slots - 1)]);
+	__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+	return n;
+}
+
+int main(void)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct profiler_ring_header *first;
+	__u32 nr_rings, ring_bytes, i;
+	__u64 dropped = 0;
+	char *rings;
+	int fd;
+
+	fd = open("/dev/" PROFILER_DEVICE_NAME, O_RDWR);
+	if (fd < 0) {
+		perror("/dev/" PROFILER_DEVICE_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	/* The first header tells how large the whole mapping is. */
+	first = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (first == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	nr_rings = first->nr_rings;
+	ring_bytes = first->ring_bytes;
+	munmap(first, page_size);
+
+	rings = mmap(NULL, (size_t)nr_rings * ring_bytes,
+		     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (rings == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	while (!stop) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int n = 0;
+
+		for (i = 0; i < nr_rings; i++)
+			n += drain((void *)(rings + (size_t)i * ring_bytes),
+				   page_size);
+		if (!n)
+			poll(&pfd, 1, 1000);
+	}
+
+	/* What is left, and how much was lost. */
+	for (i = 0; i < nr_rings; i++) {
+		struct profiler_ring_header *hdr =
+			(void *)(rings + (size_t)i * ring_bytes);
+
+		drain(hdr, page_size);
+		dropped += hdr->dropped;
+	}
+	fprintf(stderr, "%llu samples dropped\n", (unsigned long long)dropped);
+
+	close(fd);
+	return 0;
+}
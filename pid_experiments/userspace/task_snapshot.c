@@ -0,0 +1,87 @@
+/*  task_snapshot.c - follow the tasks of a pid namespace
+ *
+ *  Usage: ./task_snapshot [interval_s]
+ *
+ *  Takes a full snapshot of /proc/pid_info_tasks, then, every interval
+ *  (1 s by default), a delta against the previous one, and prints one
+ *  "<pid> <tgid> <state> <utime_ns> <stime_ns> <rss_bytes> <comm>" line
+ *  per task which changed, or "<pid> exited".
+ */
+
+#include <pid_info.h>
+
+#include <fcntl.h> /* open */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit, malloc */
+#include <unistd.h> /* read, write, sleep */
+
+/* Read a whole snapshot; returns it, to be freed. */
+static struct pid_info_snapshot *read_snapshot(int fd, __u64 cookie)
+{
+	size_t size = 1 << 16, len = 0;
+	char *buf = malloc(size);
+	ssize_t n;
+
+	if (!buf || write(fd, &cookie, sizeof(cookie)) < 0) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+	while ((n = read(fd, buf + len, size - len)) > 0) {
+		len += n;
+		if (len == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+			if (!buf) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	if (n < 0) {
+		perror("read");
+		exit(EXIT_FAILURE);
+	}
+	return (struct pid_info_snapshot *)buf;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int interval = argc > 1 ? atoi(argv[1]) : 1;
+	__u64 cookie = 0;
+	int fd;
+
+	fd = open("/proc/" PID_INFO_TASKS_PROC_NAME, O_RDWR);
+	if (fd < 0) {
+		perror("/proc/" PID_INFO_TASKS_PROC_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		struct pid_info_snapshot *snap = read_snapshot(fd, cookie);
+		const char *tasks = (const char *)(snap + 1);
+		__u32 i;
+
+		printf("# generation %llu, %s, %u tasks\n",
+		       (unsigned long long)snap->generation,
+		       snap->flags & PID_INFO_SNAPSHOT_DELTA ? "delta" : "full",
+		       snap->nr_tasks);
+		for (i = 0; i < snap->nr_tasks; i++) {
+			const struct pid_info_task *t =
+				(const void *)(tasks + i * snap->task_size);
+
+			if (t->flags & PID_INFO_TASK_EXITED) {
+				printf("%d exited\n", t->pid);
+				continue;
+			}
+			printf("%d %d %c %llu %llu %llu %.16s\n", t->pid, t->tgid,
+			       t->state, (unsigned long long)t->utime_ns,
+			       (unsigned long long)t->stime_ns,
+			       (unsigned long long)t->rss_bytes, t->comm);
+		}
+		fflush(stdout);
+
+		cookie = snap->generation;
+		free(snap);
+		sleep(interval);
+	}
+}
@@ -1,13 +1,230 @@
-#include <stdio.h>
-#include <unistd.h>
+/*  wait.c - a population of processes in nested pid namespaces
+ *
+ *  Usage: ./wait [-n nr_procs] [-d depth] [-b]
+ *
+ *  Creates depth nested pid namespaces, each with clone(CLONE_NEWPID)
+ *  from the init of the one above, and spreads nr_procs processes evenly
+ *  over the current namespace and the nested ones. The processes pause(),
+ *  or spin with -b. Once they are all up, prints one line per process
+ *  (the inits of the namespaces and this one included):
+ *
+ *      <pid> <level> <role> <pid in each namespace, outermost first>
+ *
+ *  where pid and level are relative to this program's namespace, then
+ *  waits for SIGINT, SIGTERM or SIGHUP, and kills them all. Waiting for
+ *  a signal rather than for stdin lets it run in the background, where
+ *  stdin may be /dev/null.
+ *  Creating pid namespaces takes CAP_SYS_ADMIN.
+ */
 
-int main(void)
+#define _GNU_SOURCE
+#include <errno.h> /* errno */
+#include <getopt.h> /* getopt */
+#include <sched.h> /* clone */
+#include <signal.h> /* kill */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit, strtol */
+#include <string.h> /* strncmp */
+#include <sys/prctl.h> /* prctl */
+#include <sys/wait.h> /* waitpid */
+#include <unistd.h> /* fork, pipe, pause */
+
+static int nr_procs;
+static int depth;
+static int busy;
+/* Every process reports itself on this pipe; writes of less than
+ * PIPE_BUF bytes are atomic, so lines do not mix.
+ */
+static int report_fd;
+
+/* The children of this process, to kill them on exit. */
+static pid_t *children;
+static int nr_children;
+
+static char clone_stack[1 << 16];
+
+static int procs_at(int level)
+{
+	return nr_procs / (depth + 1) + (level < nr_procs % (depth + 1));
+}
+
+/* Our pids, from /proc/self/status. /proc is the one of this program's
+ * namespace, so the first one is the pid there.
+ */
+static void report(int level, const char *role)
 {
-	long pid = getpid();
-	int c;
-	printf("My PID is: %ld\n"
-	       "I'm going to wait until input is sent to me from stdin.\n",
-	       pid);
-	c = getchar();
+	char line[512], buf[256], *tok, *save;
+	FILE *status = fopen("/proc/self/status", "r");
+	int len = 0;
+
+	while (status && fgets(buf, sizeof(buf), status)) {
+		if (strncmp(buf, "NSpid:", 6))
+			continue;
+		tok = strtok_r(buf + 6, " \t\n", &save);
+		if (!tok)
+			break;
+		len = snprintf(line, sizeof(line), "%s %d %s", tok, level,
+			       role);
+		for (; tok; tok = strtok_r(NULL, " \t\n", &save))
+			len += snprintf(line + len, sizeof(line) - len, " %s",
+					tok);
+		len += snprintf(line + len, sizeof(line) - len, "\n");
+		break;
+	}
+	if (status)
+		fclose(status);
+	if (len <= 0)
+		len = snprintf(line, sizeof(line),
+			       "# error: no NSpid at level %d\n", level);
+	if (write(report_fd, line, len) < 0)
+		_exit(EXIT_FAILURE);
+}
+
+static void fail(const char *what, int level)
+{
+	char line[128];
+	int len = snprintf(line, sizeof(line), "# error: %s at level %d: %s\n",
+			   what, level, strerror(errno));
+
+	if (write(report_fd, line, len) < 0)
+		_exit(EXIT_FAILURE);
+}
+
+static void hold(void)
+{
+	volatile unsigned long spins = 0;
+
+	if (busy)
+		for (;;)
+			spins++;
+	for (;;)
+		pause();
+}
+
+static int ns_init(void *arg);
+
+/* Spawn the processes of @level, which we are in, and the init of the
+ * next level. Every process dies with its parent.
+ */
+static void spawn(int level)
+{
+	pid_t pid;
+	int i;
+
+	for (i = 0; i < procs_at(level); i++) {
+		pid = fork();
+		if (pid < 0) {
+			fail("fork", level);
+			return;
+		}
+		if (pid == 0) {
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			report(level, busy ? "busy" : "idle");
+			hold();
+		}
+		children[nr_children++] = pid;
+	}
+
+	if (level < depth) {
+		pid = clone(ns_init, clone_stack + sizeof(clone_stack),
+			    CLONE_NEWPID | SIGCHLD, (void *)(long)(level + 1));
+		if (pid < 0) {
+			fail("clone", level);
+			return;
+		}
+		children[nr_children++] = pid;
+	}
+}
+
+/* The init of the namespace of level @arg. */
+static int ns_init(void *arg)
+{
+	int level = (long)arg;
+
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	report(level, "init");
+	nr_children = 0;
+	spawn(level);
+	for (;;) {
+		/* Reap whatever gets reparented to us. */
+		if (wait(NULL) < 0 && errno == ECHILD)
+			pause();
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int expected, fds[2], opt, i;
+	char line[512];
+	FILE *reports;
+
+	while ((opt = getopt(argc, argv, "n:d:b")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_procs = strtol(optarg, NULL, 0);
+			break;
+		case 'd':
+			depth = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			busy = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n nr_procs] [-d depth] [-b]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (nr_procs < 0 || depth < 0 || depth > 32) {
+		fprintf(stderr, "nr_procs must be >= 0, depth in [0, 32]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	children = calloc(procs_at(0) + 1, sizeof(*children));
+	if (!children || pipe(fds) < 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	report_fd = fds[1];
+	reports = fdopen(fds[0], "r");
+
+	printf("# pid level role nspid...\n");
+	fflush(stdout);
+	report(0, "main");
+	spawn(0);
+
+	/* Every process, plus the inits and ourselves. */
+	expected = nr_procs + depth + 1;
+	for (i = 0; i < expected && fgets(line, sizeof(line), reports); i++) {
+		if (line[0] == '#') {
+			fputs(line, stderr);
+			break;
+		}
+		fputs(line, stdout);
+	}
+	fflush(stdout);
+
+	if (i == expected) {
+		sigset_t stop;
+		int sig;
+
+		sigemptyset(&stop);
+		sigaddset(&stop, SIGINT);
+		sigaddset(&stop, SIGTERM);
+		sigaddset(&stop, SIGHUP);
+		sigprocmask(SIG_BLOCK, &stop, NULL);
+		fprintf(stderr,
+			"%d processes up; interrupt or kill %d to kill them.\n",
+			expected - 1, getpid());
+		sigwait(&stop, &sig);
+	}
+
+	/* Killing the init of a namespace kills all the processes in it. */
+	for (i = 0; i < nr_children; i++)
+		kill(children[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
 	return 0;
 }
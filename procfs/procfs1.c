@@ -9,6 +9,7 @@
 #include <linux/proc_fs.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <modstats.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
 /* proc_ops are used specifically for proc management, but are a newer
@@ -20,6 +21,8 @@
 #define PROCFS_NAME "helloworld"
 
 static struct proc_dir_entry *our_proc_file;
+/* Operation statistics, under /sys/kernel/procfs1/stats */
+static struct modstats *stats;
 
 static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 			     size_t buffer_length, loff_t *offset)
@@ -27,6 +30,7 @@ static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 	char s[13] = "HelloWorld!\n";
 	int len = sizeof(s);
 	ssize_t ret = len;
+	u64 start = modstats_start();
 
 	if (*offset >= len)
 		ret = 0;
@@ -39,6 +43,7 @@ static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 		*offset += len;
 	}
 
+	modstats_record(stats, MODSTATS_READ, start, ret);
 	return ret;
 }
 
@@ -54,10 +59,15 @@ static const struct file_operations proc_file_fops = {
 
 static int __init procfs1_init(void)
 {
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
+
 	our_proc_file = proc_create(PROCFS_NAME, 0644, NULL, &proc_file_fops);
 	if (NULL == our_proc_file) {
 		proc_remove(our_proc_file);
 		pr_alert("Error:Could not initialize /proc/%s\n", PROCFS_NAME);
+		modstats_unregister(stats);
 		return -ENOMEM;
 	}
 
@@ -68,6 +78,7 @@ static int __init procfs1_init(void)
 static void __exit procfs1_exit(void)
 {
 	proc_remove(our_proc_file);
+	modstats_unregister(stats);
 	pr_info("/proc/%s removed\n", PROCFS_NAME);
 }
 
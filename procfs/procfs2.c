@@ -3,9 +3,12 @@
 
 #include <linux/kernel.h> /* We're doing kernel work */
 #include <linux/module.h> /* Specifically, a module */
+#include <linux/poll.h> /* for poll_wait() */
 #include <linux/proc_fs.h> /* Necessary because we use the proc fs */
 #include <linux/uaccess.h> /* for copy_from_user */
 #include <linux/version.h>
+#include <linux/wait.h> /* for wait_queue_head_t */
+#include <modstats.h> /* for modstats_record() */
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
 #define HAVE_PROC_OPS
@@ -17,12 +20,34 @@
 /* This structure hold information about the /proc file */
 static struct proc_dir_entry *our_proc_file;
 
+/* Operation statistics, under /sys/kernel/procfs2/stats */
+static struct modstats *stats;
+
 /* The buffer used to store character for this module */
 static char procfs_buffer[PROCFS_MAX_SIZE];
 
 /* The size of the buffer */
 static unsigned long procfs_buffer_size = 0;
 
+/* Pollers sleep here until the buffer is written again. */
+static DECLARE_WAIT_QUEUE_HEAD(procfs_wait);
+
+/* Bumped on every write. Each open file remembers in its private_data
+ * the generation it has last read, so poll() can tell it apart from a
+ * newer one.
+ */
+static atomic_t procfs_generation = ATOMIC_INIT(0);
+
+/* This function is called when the /proc file is opened */
+static int procfile_open(struct inode *inode, struct file *file)
+{
+	u64 start = modstats_start();
+
+	file->private_data = (void *)(long)atomic_read(&procfs_generation);
+	modstats_record(stats, MODSTATS_OPEN, start, 0);
+	return 0;
+}
+
 /* This function is called then the /proc file is read */
 static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 			     size_t buffer_length, loff_t *offset)
@@ -30,6 +55,11 @@ static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 	char s[13] = "HelloWorld!\n";
 	int len = sizeof(s);
 	ssize_t ret = len;
+	u64 start = modstats_start();
+	/* Taken before the copy: a write racing with it is then seen as
+	 * new, at worst once too many, rather than never.
+	 */
+	long generation = atomic_read(&procfs_generation);
 
 	if (*offset >= len || copy_to_user(buffer, s, len)) {
 		pr_info("copy_to_user failed\n");
@@ -38,8 +68,11 @@ static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 		pr_info("procfile read %s\n",
 			file_pointer->f_path.dentry->d_name.name);
 		*offset += len;
+		/* The reader has now seen that generation. */
+		file_pointer->private_data = (void *)generation;
 	}
 
+	modstats_record(stats, MODSTATS_READ, start, ret);
 	return ret;
 }
 
@@ -47,37 +80,72 @@ static ssize_t procfile_read(struct file *file_pointer, char __user *buffer,
 static ssize_t procfile_write(struct file *file, const char __user *buff,
 			      size_t len, loff_t *off)
 {
+	u64 start = modstats_start();
+
 	procfs_buffer_size = len;
 	if (procfs_buffer_size > PROCFS_MAX_SIZE)
 		procfs_buffer_size = PROCFS_MAX_SIZE;
 
-	if (copy_from_user(procfs_buffer, buff, procfs_buffer_size))
+	if (copy_from_user(procfs_buffer, buff, procfs_buffer_size)) {
+		modstats_record(stats, MODSTATS_WRITE, start, -EFAULT);
 		return -EFAULT;
+	}
 
 	procfs_buffer[procfs_buffer_size & (PROCFS_MAX_SIZE - 1)] = '\0';
 	*off += procfs_buffer_size;
 	pr_info("procfile write %s\n", procfs_buffer);
 
+	atomic_inc(&procfs_generation);
+	wake_up_interruptible(&procfs_wait);
+
+	modstats_record(stats, MODSTATS_WRITE, start, procfs_buffer_size);
 	return procfs_buffer_size;
 }
 
+/* This function is called by poll(2), select(2) and epoll(7). Like
+ * sysfs attributes, the file is always readable; a change since the
+ * last read is signalled with EPOLLPRI, so a consumer should wait for
+ * POLLPRI and then re-read the file from offset 0.
+ */
+static __poll_t procfile_poll(struct file *file, poll_table *wait)
+{
+	__poll_t mask = DEFAULT_POLLMASK;
+	u64 start = modstats_start();
+
+	poll_wait(file, &procfs_wait, wait);
+	if ((long)file->private_data != atomic_read(&procfs_generation))
+		mask |= EPOLLPRI;
+
+	modstats_record(stats, MODSTATS_POLL, start, 0);
+	return mask;
+}
+
 #ifdef HAVE_PROC_OPS
 static const struct proc_ops proc_file_fops = {
+	.proc_open = procfile_open,
 	.proc_read = procfile_read,
 	.proc_write = procfile_write,
+	.proc_poll = procfile_poll,
 };
 #else
 static const struct file_operations proc_file_fops = {
+	.open = procfile_open,
 	.read = procfile_read,
 	.write = procfile_write,
+	.poll = procfile_poll,
 };
 #endif
 
 static int __init procfs2_init(void)
 {
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
+
 	our_proc_file = proc_create(PROCFS_NAME, 0644, NULL, &proc_file_fops);
 	if (NULL == our_proc_file) {
 		pr_alert("Error:Could not initialize /proc/%s\n", PROCFS_NAME);
+		modstats_unregister(stats);
 		return -ENOMEM;
 	}
 
@@ -88,6 +156,7 @@ static int __init procfs2_init(void)
 static void __exit procfs2_exit(void)
 {
 	proc_remove(our_proc_file);
+	modstats_unregister(stats);
 	pr_info("/proc/%s removed\n", PROCFS_NAME);
 }
 
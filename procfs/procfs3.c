@@ -3,10 +3,13 @@
 
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/poll.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/wait.h>
+#include <modstats.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
 #include <linux/minmax.h>
 #endif
@@ -21,42 +24,86 @@
 static struct proc_dir_entry *our_proc_file;
 static char procfs_buffer[PROCFS_MAX_SIZE];
 static unsigned long procfs_buffer_size = 0;
+/* Operation statistics, under /sys/kernel/procfs3/stats */
+static struct modstats *stats;
+
+/* Pollers sleep on procfs_wait until procfs_generation moves past the
+ * generation their file last read (kept in file->private_data).
+ */
+static DECLARE_WAIT_QUEUE_HEAD(procfs_wait);
+static atomic_t procfs_generation = ATOMIC_INIT(0);
 
 static ssize_t procfs_read(struct file *filp, char __user *buffer,
 			   size_t length, loff_t *offset)
 {
+	u64 start = modstats_start();
+	/* Taken before the copy: a write racing with it is then seen as
+	 * new, at worst once too many, rather than never.
+	 */
+	long generation = atomic_read(&procfs_generation);
+
 	if (*offset || procfs_buffer_size == 0) {
 		pr_debug("procfs_read: END\n");
 		*offset = 0;
+		modstats_record(stats, MODSTATS_READ, start, 0);
 		return 0;
 	}
 	procfs_buffer_size = min(procfs_buffer_size, length);
-	if (copy_to_user(buffer, procfs_buffer, procfs_buffer_size))
+	if (copy_to_user(buffer, procfs_buffer, procfs_buffer_size)) {
+		modstats_record(stats, MODSTATS_READ, start, -EFAULT);
 		return -EFAULT;
+	}
 	*offset += procfs_buffer_size;
+	filp->private_data = (void *)generation;
 
 	pr_debug("procfs_read: read %lu bytes\n", procfs_buffer_size);
+	modstats_record(stats, MODSTATS_READ, start, procfs_buffer_size);
 	return procfs_buffer_size;
 }
 static ssize_t procfs_write(struct file *file, const char __user *buffer,
 			    size_t len, loff_t *off)
 {
+	u64 start = modstats_start();
+
 	procfs_buffer_size = min(PROCFS_MAX_SIZE, len);
-	if (copy_from_user(procfs_buffer, buffer, procfs_buffer_size))
+	if (copy_from_user(procfs_buffer, buffer, procfs_buffer_size)) {
+		modstats_record(stats, MODSTATS_WRITE, start, -EFAULT);
 		return -EFAULT;
+	}
 	*off += procfs_buffer_size;
+	atomic_inc(&procfs_generation);
+	wake_up_interruptible(&procfs_wait);
 
 	pr_debug("procfs_write: write %lu bytes\n", procfs_buffer_size);
+	modstats_record(stats, MODSTATS_WRITE, start, procfs_buffer_size);
 	return procfs_buffer_size;
 }
+static __poll_t procfs_poll(struct file *file, poll_table *wait)
+{
+	__poll_t mask = DEFAULT_POLLMASK;
+	u64 start = modstats_start();
+
+	poll_wait(file, &procfs_wait, wait);
+	if ((long)file->private_data != atomic_read(&procfs_generation))
+		mask |= EPOLLPRI;
+	modstats_record(stats, MODSTATS_POLL, start, 0);
+	return mask;
+}
 static int procfs_open(struct inode *inode, struct file *file)
 {
+	u64 start = modstats_start();
+
 	try_module_get(THIS_MODULE);
+	file->private_data = (void *)(long)atomic_read(&procfs_generation);
+	modstats_record(stats, MODSTATS_OPEN, start, 0);
 	return 0;
 }
 static int procfs_close(struct inode *inode, struct file *file)
 {
+	u64 start = modstats_start();
+
 	module_put(THIS_MODULE);
+	modstats_record(stats, MODSTATS_RELEASE, start, 0);
 	return 0;
 }
 
@@ -66,6 +113,7 @@ static struct proc_ops file_ops_4_our_proc_file = {
 	.proc_write = procfs_write,
 	.proc_open = procfs_open,
 	.proc_release = procfs_close,
+	.proc_poll = procfs_poll,
 };
 #else
 static const struct file_operations file_ops_4_our_proc_file = {
@@ -73,16 +121,22 @@ static const struct file_operations file_ops_4_our_proc_file = {
 	.write = procfs_write,
 	.open = procfs_open,
 	.release = procfs_close,
+	.poll = procfs_poll,
 };
 #endif
 
 static int __init procfs3_init(void)
 {
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
+
 	our_proc_file = proc_create(PROCFS_ENTRY_FILENAME, 0644, NULL,
 				    &file_ops_4_our_proc_file);
 	if (our_proc_file == NULL) {
 		pr_debug("Error: Could not initialize /proc/%s\n",
 			 PROCFS_ENTRY_FILENAME);
+		modstats_unregister(stats);
 		return -ENOMEM;
 	}
 	proc_set_size(our_proc_file, 80);
@@ -95,6 +149,7 @@ static int __init procfs3_init(void)
 static void __exit procfs3_exit(void)
 {
 	remove_proc_entry(PROCFS_ENTRY_FILENAME, NULL);
+	modstats_unregister(stats);
 	pr_debug("/proc/%s removed\n", PROCFS_ENTRY_FILENAME);
 }
 
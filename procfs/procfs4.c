@@ -7,6 +7,7 @@
 #include <linux/proc_fs.h> /* Necessary because we use proc fs */
 #include <linux/seq_file.h> /* for seq_file */
 #include <linux/version.h>
+#include <modstats.h> /* for modstats_record() */
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
 #define HAVE_PROC_OPS
@@ -14,6 +15,9 @@
 
 #define PROC_NAME "iter"
 
+/* Operation statistics, under /sys/kernel/procfs4/stats */
+static struct modstats *stats;
+
 /* This function is called at the beginning of a sequence.
  * ie, when:
  *   - the /proc file is read (first time)
@@ -71,23 +75,47 @@ static struct seq_operations my_seq_ops = {
 /* This function is called when the /proc file is open. */
 static int my_open(struct inode *inode, struct file *file)
 {
-	return seq_open(file, &my_seq_ops);
+	u64 start = modstats_start();
+	int ret = seq_open(file, &my_seq_ops);
+
+	modstats_record(stats, MODSTATS_OPEN, start, ret);
+	return ret;
 };
 
+/* The seq_file library does the work; we only count. */
+static ssize_t my_read(struct file *file, char __user *buf, size_t size,
+		       loff_t *ppos)
+{
+	u64 start = modstats_start();
+	ssize_t ret = seq_read(file, buf, size, ppos);
+
+	modstats_record(stats, MODSTATS_READ, start, ret);
+	return ret;
+}
+
+static int my_release(struct inode *inode, struct file *file)
+{
+	u64 start = modstats_start();
+	int ret = seq_release(inode, file);
+
+	modstats_record(stats, MODSTATS_RELEASE, start, ret);
+	return ret;
+}
+
 /* This structure gather "function" that manage the /proc file */
 #ifdef HAVE_PROC_OPS
 static const struct proc_ops my_file_ops = {
 	.proc_open = my_open,
-	.proc_read = seq_read,
+	.proc_read = my_read,
 	.proc_lseek = seq_lseek,
-	.proc_release = seq_release,
+	.proc_release = my_release,
 };
 #else
 static const struct file_operations my_file_ops = {
 	.open = my_open,
-	.read = seq_read,
+	.read = my_read,
 	.llseek = seq_lseek,
-	.release = seq_release,
+	.release = my_release,
 };
 #endif
 
@@ -95,9 +123,14 @@ static int __init procfs4_init(void)
 {
 	struct proc_dir_entry *entry;
 
+	stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(stats))
+		return PTR_ERR(stats);
+
 	entry = proc_create(PROC_NAME, 0, NULL, &my_file_ops);
 	if (entry == NULL) {
 		pr_debug("Error: Could not initialize /proc/%s\n", PROC_NAME);
+		modstats_unregister(stats);
 		return -ENOMEM;
 	}
 
@@ -107,6 +140,7 @@ static int __init procfs4_init(void)
 static void __exit procfs4_exit(void)
 {
 	remove_proc_entry(PROC_NAME, NULL);
+	modstats_unregister(stats);
 	pr_debug("/proc/%s removed\n", PROC_NAME);
 }
 
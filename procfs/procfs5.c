@@ -0,0 +1,395 @@
+/* procfs5.c - a large /proc buffer kept compressed in memory
+ *
+ * Like procfs3.c, but the buffer may grow up to max_size bytes. The data
+ * is cut into CHUNK_SIZE chunks; every full chunk is compressed with LZ4
+ * through the kernel crypto compression API, and reads decompress the
+ * chunks they touch through a small cache. Load with compress=0 to keep
+ * the chunks raw, for comparison.
+ *
+ *     $ cat big.log > /proc/buffer_lz4
+ *     $ cat /proc/buffer_lz4
+ *     $ cat /proc/buffer_lz4_stats
+ *
+ * Writing at offset 0 replaces the contents; any other write must
+ * append to them.
+ */
+
+#include <linux/crypto.h> /* for crypto_comp_{,de}compress() */
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/mm.h> /* for kvcalloc() */
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <modstats.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define HAVE_PROC_OPS
+#endif
+
+#define PROCFS_ENTRY_FILENAME "buffer_lz4"
+#define PROCFS_STATS_FILENAME "buffer_lz4_stats"
+#define CHUNK_SIZE PAGE_SIZE
+/* Number of decompressed chunks kept around for reads. */
+#define CACHE_SLOTS 4
+
+static bool compress = true;
+module_param(compress, bool, 0444);
+MODULE_PARM_DESC(compress, "Store the chunks LZ4-compressed (default: Y).");
+
+static unsigned long max_size = 16UL << 20;
+module_param(max_size, ulong, 0444);
+MODULE_PARM_DESC(max_size, "Largest size of the buffer in bytes.");
+
+/* A full chunk of the buffer. When len == CHUNK_SIZE, LZ4 did not help
+ * and the data is stored raw.
+ */
+struct chunk {
+	unsigned int len;
+	u8 data[];
+};
+
+struct cache_slot {
+	long index; /* the chunk held in data, or -1 */
+	u8 *data;
+};
+
+static struct proc_dir_entry *our_proc_file;
+static struct proc_dir_entry *our_stats_file;
+/* Operation statistics, under /sys/kernel/procfs5/stats */
+static struct modstats *op_stats;
+
+/* Protects everything below, including the (single) tfm. */
+static DEFINE_MUTEX(buffer_lock);
+static struct crypto_comp *tfm;
+static struct chunk **chunks;
+static unsigned long max_chunks;
+static unsigned long nr_chunks;
+/* The last, partially filled chunk is kept raw until it fills up. */
+static u8 *tail;
+static unsigned long tail_len;
+/* Output buffer of the compressor. */
+static u8 *scratch;
+static struct cache_slot cache[CACHE_SLOTS];
+
+static struct {
+	u64 stored_bytes; /* sum of chunks[i]->len */
+	u64 bytes_written;
+	u64 bytes_read;
+	u64 write_ns;
+	u64 read_ns;
+	u64 cache_hits;
+	u64 cache_misses;
+} stats;
+
+static unsigned long buffer_size(void)
+{
+	return nr_chunks * CHUNK_SIZE + tail_len;
+}
+
+static void buffer_reset(void)
+{
+	int i;
+
+	while (nr_chunks)
+		kfree(chunks[--nr_chunks]);
+	tail_len = 0;
+	stats.stored_bytes = 0;
+	for (i = 0; i < CACHE_SLOTS; i++)
+		cache[i].index = -1;
+}
+
+/* Move the full tail into a new, possibly compressed, chunk. */
+static int seal_tail(void)
+{
+	unsigned int dlen = CHUNK_SIZE;
+	const u8 *src = scratch;
+	struct chunk *c;
+
+	/* The compressor fails when the output does not fit in dlen, i.e.
+	 * when the chunk is incompressible.
+	 */
+	if (!compress ||
+	    crypto_comp_compress(tfm, tail, CHUNK_SIZE, scratch, &dlen) ||
+	    dlen >= CHUNK_SIZE) {
+		src = tail;
+		dlen = CHUNK_SIZE;
+	}
+
+	c = kmalloc(struct_size(c, data, dlen), GFP_KERNEL);
+	if (!c)
+		return -ENOMEM;
+	c->len = dlen;
+	memcpy(c->data, src, dlen);
+	chunks[nr_chunks++] = c;
+	stats.stored_bytes += dlen;
+	tail_len = 0;
+	return 0;
+}
+
+/* Return the raw contents of a full chunk, or NULL if it is corrupt. */
+static const u8 *get_chunk(unsigned long index)
+{
+	struct cache_slot *slot = &cache[index % CACHE_SLOTS];
+	struct chunk *c = chunks[index];
+	unsigned int dlen = CHUNK_SIZE;
+
+	if (c->len == CHUNK_SIZE)
+		return c->data;
+	if (slot->index == (long)index) {
+		stats.cache_hits++;
+		return slot->data;
+	}
+
+	stats.cache_misses++;
+	slot->index = -1;
+	if (crypto_comp_decompress(tfm, c->data, c->len, slot->data, &dlen) ||
+	    dlen != CHUNK_SIZE)
+		return NULL;
+	slot->index = index;
+	return slot->data;
+}
+
+static ssize_t procfs_read(struct file *filp, char __user *buffer,
+			   size_t length, loff_t *offset)
+{
+	u64 start = modstats_start();
+	size_t done = 0;
+	ssize_t ret = 0;
+	unsigned long size;
+
+	mutex_lock(&buffer_lock);
+	size = buffer_size();
+	while (done < length && *offset < size) {
+		unsigned long index = *offset / CHUNK_SIZE;
+		unsigned long in_chunk = *offset % CHUNK_SIZE;
+		size_t n = min_t(size_t, length - done, CHUNK_SIZE - in_chunk);
+		const u8 *src;
+
+		n = min_t(size_t, n, size - *offset);
+		src = index < nr_chunks ? get_chunk(index) : tail;
+		if (!src) {
+			ret = -EIO;
+			break;
+		}
+		if (copy_to_user(buffer + done, src + in_chunk, n)) {
+			ret = -EFAULT;
+			break;
+		}
+		done += n;
+		*offset += n;
+	}
+	stats.bytes_read += done;
+	stats.read_ns += ktime_get_ns() - start;
+	mutex_unlock(&buffer_lock);
+
+	pr_debug("procfs_read: read %zu bytes\n", done);
+	ret = done ? done : ret;
+	modstats_record(op_stats, MODSTATS_READ, start, ret);
+	return ret;
+}
+
+static ssize_t procfs_write(struct file *file, const char __user *buffer,
+			    size_t len, loff_t *off)
+{
+	u64 start = modstats_start();
+	size_t done = 0;
+	ssize_t ret = 0;
+
+	mutex_lock(&buffer_lock);
+	if (*off == 0) {
+		buffer_reset();
+	} else if (*off != buffer_size()) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	while (done < len) {
+		size_t n;
+
+		if (buffer_size() >= max_chunks * CHUNK_SIZE) {
+			ret = -ENOSPC;
+			break;
+		}
+		if (tail_len == CHUNK_SIZE) {
+			ret = seal_tail();
+			if (ret)
+				break;
+		}
+		n = min_t(size_t, len - done, CHUNK_SIZE - tail_len);
+		if (copy_from_user(tail + tail_len, buffer + done, n)) {
+			ret = -EFAULT;
+			break;
+		}
+		tail_len += n;
+		done += n;
+	}
+	*off += done;
+	stats.bytes_written += done;
+	stats.write_ns += ktime_get_ns() - start;
+out:
+	mutex_unlock(&buffer_lock);
+
+	pr_debug("procfs_write: write %zu bytes\n", done);
+	ret = done ? done : ret;
+	modstats_record(op_stats, MODSTATS_WRITE, start, ret);
+	return ret;
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops file_ops_4_our_proc_file = {
+	.proc_read = procfs_read,
+	.proc_write = procfs_write,
+};
+#else
+static const struct file_operations file_ops_4_our_proc_file = {
+	.owner = THIS_MODULE,
+	.read = procfs_read,
+	.write = procfs_write,
+};
+#endif
+
+/* Throughput in MB/s, i.e. bytes per microsecond. */
+static u64 mb_per_s(u64 bytes, u64 ns)
+{
+	return ns ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static int stats_show(struct seq_file *m, void *v)
+{
+	u64 footprint;
+	unsigned long size;
+
+	mutex_lock(&buffer_lock);
+	size = buffer_size();
+	/* Chunk data, the chunk table, the tail, the cache and scratch. */
+	footprint = stats.stored_bytes + nr_chunks * sizeof(struct chunk) +
+		    max_chunks * sizeof(*chunks) +
+		    (2 + CACHE_SLOTS) * CHUNK_SIZE;
+
+	seq_printf(m, "compress:       %s\n", compress ? "lz4" : "none");
+	seq_printf(m, "size:           %lu\n", size);
+	seq_printf(m, "chunks:         %lu\n", nr_chunks);
+	seq_printf(m, "stored_bytes:   %llu\n", stats.stored_bytes);
+	seq_printf(m, "footprint:      %llu\n", footprint);
+	seq_printf(m, "ratio_percent:  %llu\n",
+		   size ? div64_u64(footprint * 100, size) : 0);
+	seq_printf(m, "bytes_written:  %llu\n", stats.bytes_written);
+	seq_printf(m, "bytes_read:     %llu\n", stats.bytes_read);
+	seq_printf(m, "write_MBps:     %llu\n",
+		   mb_per_s(stats.bytes_written, stats.write_ns));
+	seq_printf(m, "read_MBps:      %llu\n",
+		   mb_per_s(stats.bytes_read, stats.read_ns));
+	seq_printf(m, "cache_hits:     %llu\n", stats.cache_hits);
+	seq_printf(m, "cache_misses:   %llu\n", stats.cache_misses);
+	mutex_unlock(&buffer_lock);
+	return 0;
+}
+
+static int stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, stats_show, NULL);
+}
+
+#ifdef HAVE_PROC_OPS
+static const struct proc_ops stats_ops = {
+	.proc_open = stats_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = single_release,
+};
+#else
+static const struct file_operations stats_ops = {
+	.owner = THIS_MODULE,
+	.open = stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+static void free_buffers(void)
+{
+	int i;
+
+	buffer_reset();
+	for (i = 0; i < CACHE_SLOTS; i++)
+		kfree(cache[i].data);
+	kfree(scratch);
+	kfree(tail);
+	kvfree(chunks);
+	if (!IS_ERR_OR_NULL(tfm))
+		crypto_free_comp(tfm);
+}
+
+static int __init procfs5_init(void)
+{
+	int i;
+
+	max_chunks = DIV_ROUND_UP(max_size, CHUNK_SIZE);
+	if (!max_chunks)
+		return -EINVAL;
+
+	op_stats = modstats_register(KBUILD_MODNAME);
+	if (IS_ERR(op_stats))
+		return PTR_ERR(op_stats);
+
+	if (compress) {
+		tfm = crypto_alloc_comp("lz4", 0, 0);
+		if (IS_ERR(tfm)) {
+			pr_alert("Error: lz4 is not available: %ld\n",
+				 PTR_ERR(tfm));
+			modstats_unregister(op_stats);
+			return PTR_ERR(tfm);
+		}
+	}
+
+	chunks = kvcalloc(max_chunks, sizeof(*chunks), GFP_KERNEL);
+	tail = kmalloc(CHUNK_SIZE, GFP_KERNEL);
+	scratch = kmalloc(CHUNK_SIZE, GFP_KERNEL);
+	if (!chunks || !tail || !scratch)
+		goto error;
+	for (i = 0; i < CACHE_SLOTS; i++) {
+		cache[i].index = -1;
+		cache[i].data = kmalloc(CHUNK_SIZE, GFP_KERNEL);
+		if (!cache[i].data)
+			goto error;
+	}
+
+	our_proc_file = proc_create(PROCFS_ENTRY_FILENAME, 0644, NULL,
+				    &file_ops_4_our_proc_file);
+	our_stats_file =
+		proc_create(PROCFS_STATS_FILENAME, 0444, NULL, &stats_ops);
+	if (!our_proc_file || !our_stats_file) {
+		pr_alert("Error: Could not initialize /proc/%s\n",
+			 PROCFS_ENTRY_FILENAME);
+		proc_remove(our_stats_file);
+		proc_remove(our_proc_file);
+		goto error;
+	}
+
+	pr_debug("/proc/%s created\n", PROCFS_ENTRY_FILENAME);
+	return 0;
+error:
+	free_buffers();
+	modstats_unregister(op_stats);
+	return -ENOMEM;
+}
+
+static void __exit procfs5_exit(void)
+{
+	proc_remove(our_stats_file);
+	proc_remove(our_proc_file);
+	free_buffers();
+	modstats_unregister(op_stats);
+	pr_debug("/proc/%s removed\n", PROCFS_ENTRY_FILENAME);
+}
+
+module_init(procfs5_init);
+module_exit(procfs5_exit);
+
+MODULE_LICENSE("GPL");
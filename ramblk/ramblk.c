@@ -0,0 +1,280 @@
+/*
+ * ramblk.c
+ *
+ * A block device in RAM, /dev/ramblk0, to measure what the block layer
+ * costs when the storage costs nothing.
+ *
+ * Requests go through blk-mq, with one hardware queue per CPU, so a
+ * request is submitted and completed on the CPU which issued it, and
+ * queues never contend. The data is in one zeroed vmalloc area of
+ * size_mb MiB, allocated at load time, so that serving a request is only
+ * copying its segments.
+ *
+ * With direct=1, the same memory is also exported by the character
+ * device /dev/ramblk_direct: read() and write() copy straight between
+ * the user's buffer and the store, and mmap() maps the store itself, as
+ * DAX does for persistent memory. There is no bio, no request and no
+ * page cache in the way, which gives the baseline to compare the block
+ * device with. See the job files in fio/.
+ */
+
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/device.h> /* For class_create() */
+#include <linux/fs.h>
+#include <linux/highmem.h> /* For bvec_kmap_local() */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+
+#define DISK_NAME "ramblk0"
+#define DIRECT_NAME "ramblk_direct"
+
+static unsigned int size_mb = 256;
+module_param(size_mb, uint, 0444);
+MODULE_PARM_DESC(size_mb, "Size of the device in MiB (default: 256).");
+
+static unsigned int queue_depth = 128;
+module_param(queue_depth, uint, 0444);
+MODULE_PARM_DESC(queue_depth, "Requests per hardware queue (default: 128).");
+
+static bool direct;
+module_param(direct, bool, 0444);
+MODULE_PARM_DESC(direct, "Also export the store as /dev/" DIRECT_NAME ".");
+
+static void *store;
+static size_t store_size;
+
+static int major;
+static struct blk_mq_tag_set tag_set;
+static struct gendisk *disk;
+
+static int direct_major;
+static struct class *cls;
+
+/* Requests are served at once, in the context which submits them. */
+static blk_status_t ramblk_queue_rq(struct blk_mq_hw_ctx *hctx,
+				    const struct blk_mq_queue_data *bd)
+{
+	struct request *rq = bd->rq;
+	size_t pos = (size_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+	blk_status_t status = BLK_STS_OK;
+	struct req_iterator iter;
+	struct bio_vec bvec;
+
+	blk_mq_start_request(rq);
+
+	if (pos + blk_rq_bytes(rq) > store_size) {
+		status = BLK_STS_IOERR;
+		goto out;
+	}
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+	case REQ_OP_WRITE:
+		rq_for_each_segment(bvec, rq, iter) {
+			void *buf = bvec_kmap_local(&bvec);
+
+			if (op_is_write(req_op(rq)))
+				memcpy(store + pos, buf, bvec.bv_len);
+			else
+				memcpy(buf, store + pos, bvec.bv_len);
+			kunmap_local(buf);
+			pos += bvec.bv_len;
+		}
+		break;
+	case REQ_OP_FLUSH:
+		break;
+	default:
+		status = BLK_STS_NOTSUPP;
+	}
+out:
+	blk_mq_end_request(rq, status);
+	return BLK_STS_OK;
+}
+
+static const struct blk_mq_ops ramblk_mq_ops = {
+	.queue_rq = ramblk_queue_rq,
+};
+
+static const struct block_device_operations ramblk_fops = {
+	.owner = THIS_MODULE,
+};
+
+static ssize_t direct_read(struct file *file, char __user *buf, size_t count,
+			   loff_t *ppos)
+{
+	loff_t pos = *ppos;
+
+	if (pos >= store_size)
+		return 0;
+	count = min_t(size_t, count, store_size - pos);
+	if (copy_to_user(buf, store + pos, count))
+		return -EFAULT;
+	*ppos = pos + count;
+	return count;
+}
+
+static ssize_t direct_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	loff_t pos = *ppos;
+
+	if (pos >= store_size)
+		return -ENOSPC;
+	count = min_t(size_t, count, store_size - pos);
+	if (copy_from_user(store + pos, buf, count))
+		return -EFAULT;
+	*ppos = pos + count;
+	return count;
+}
+
+static loff_t direct_llseek(struct file *file, loff_t offset, int whence)
+{
+	return fixed_size_llseek(file, offset, whence, store_size);
+}
+
+/* The store was allocated with vmalloc_user(), for this. */
+static int direct_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return remap_vmalloc_range(vma, store, vma->vm_pgoff);
+}
+
+static struct file_operations direct_fops = {
+	.owner = THIS_MODULE,
+	.read = direct_read,
+	.write = direct_write,
+	.llseek = direct_llseek,
+	.mmap = direct_mmap,
+};
+
+/* Before v6.0, a disk of blk-mq also had its queue to clean up. */
+static void ramblk_put_disk(void)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 0, 0)
+	blk_cleanup_disk(disk);
+#else
+	put_disk(disk);
+#endif
+}
+
+static int direct_init(void)
+{
+	direct_major = register_chrdev(0, DIRECT_NAME, &direct_fops);
+	if (direct_major < 0)
+		return direct_major;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	cls = class_create(DIRECT_NAME);
+#else
+	cls = class_create(THIS_MODULE, DIRECT_NAME);
+#endif
+	device_create(cls, NULL, MKDEV(direct_major, 0), NULL, DIRECT_NAME);
+	return 0;
+}
+
+static void direct_exit(void)
+{
+	device_destroy(cls, MKDEV(direct_major, 0));
+	class_destroy(cls);
+	unregister_chrdev(direct_major, DIRECT_NAME);
+}
+
+static int __init ramblk_init(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+	struct queue_limits lim = {
+		.logical_block_size = SECTOR_SIZE,
+		.physical_block_size = PAGE_SIZE,
+	};
+#endif
+	int ret;
+
+	if (!size_mb || !queue_depth)
+		return -EINVAL;
+	store_size = (size_t)size_mb << 20;
+	/* Zeroed, and suitable for remap_vmalloc_range(). */
+	store = vmalloc_user(store_size);
+	if (!store)
+		return -ENOMEM;
+
+	major = register_blkdev(0, KBUILD_MODNAME);
+	if (major < 0) {
+		ret = major;
+		goto free_store;
+	}
+
+	tag_set.ops = &ramblk_mq_ops;
+	tag_set.nr_hw_queues = nr_cpu_ids;
+	tag_set.queue_depth = queue_depth;
+	tag_set.numa_node = NUMA_NO_NODE;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 14, 0)
+	tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+#endif
+	ret = blk_mq_alloc_tag_set(&tag_set);
+	if (ret)
+		goto unregister;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+	disk = blk_mq_alloc_disk(&tag_set, &lim, NULL);
+#else
+	disk = blk_mq_alloc_disk(&tag_set, NULL);
+#endif
+	if (IS_ERR(disk)) {
+		ret = PTR_ERR(disk);
+		goto free_tags;
+	}
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 9, 0)
+	blk_queue_logical_block_size(disk->queue, SECTOR_SIZE);
+	blk_queue_physical_block_size(disk->queue, PAGE_SIZE);
+#endif
+	disk->major = major;
+	disk->first_minor = 0;
+	disk->minors = 1;
+	disk->fops = &ramblk_fops;
+	strscpy(disk->disk_name, DISK_NAME, sizeof(disk->disk_name));
+	set_capacity(disk, store_size >> SECTOR_SHIFT);
+
+	ret = add_disk(disk);
+	if (ret)
+		goto cleanup_disk;
+
+	if (direct) {
+		ret = direct_init();
+		if (ret) {
+			del_gendisk(disk);
+			goto cleanup_disk;
+		}
+	}
+
+	pr_info("%s: /dev/%s, %u MiB, %u hardware queues\n", KBUILD_MODNAME,
+		DISK_NAME, size_mb, tag_set.nr_hw_queues);
+	return 0;
+
+cleanup_disk:
+	ramblk_put_disk();
+free_tags:
+	blk_mq_free_tag_set(&tag_set);
+unregister:
+	unregister_blkdev(major, KBUILD_MODNAME);
+free_store:
+	vfree(store);
+	return ret;
+}
+
+static void __exit ramblk_exit(void)
+{
+	if (direct)
+		direct_exit();
+	del_gendisk(disk);
+	ramblk_put_disk();
+	blk_mq_free_tag_set(&tag_set);
+	unregister_blkdev(major, KBUILD_MODNAME);
+	vfree(store);
+}
+
+module_init(ramblk_init);
+module_exit(ramblk_exit);
+
+MODULE_LICENSE("GPL");
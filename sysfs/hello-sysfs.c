@@ -5,6 +5,17 @@
  * Or write to:
  *    $ echo 42 > /sys/kernel/mymodule/myvariable
  *
+ * Accesses to myvariable are counted in per-CPU statistics, which are
+ * summed up when read from the attribute group under
+ *     $ /sys/kernel/mymodule/stats/
+ * and zeroed with
+ *     $ echo 1 > /sys/kernel/mymodule/stats/reset
+ *
+ * All of them are also packed into the binary file
+ *     $ /sys/kernel/mymodule/metrics
+ * whose layout is struct mymodule_metrics in include/mymodule.h. It can
+ * be read in one go or mapped; see userspace/bench.c.
+ *
  * kobject is the glue between the device model and the sysfs
  * interface.
  *
@@ -15,27 +26,124 @@
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/sysfs.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include <mymodule.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+/* The bin_attribute callbacks take a const attribute since v6.13. */
+#define BIN_ATTR_CONST const
+#else
+#define BIN_ATTR_CONST
+#endif
+
+/* Number of buckets of the latency histogram. Bucket i counts
+ * latencies in [2^i, 2^(i+1)) ns; the last one also counts anything
+ * longer.
+ */
+#define HIST_BUCKETS MYMODULE_HIST_BUCKETS
 
 static struct kobject *mymodule;
 
 /* the variable you want to be able to change */
 static int myvariable = 0;
 
+/* Each CPU only ever updates its own copy of the statistics, with
+ * this_cpu_*() operations: no locks, no atomics and no shared cache
+ * lines on the hot path. The cost moves to the (rare) readers, which
+ * sum up the copies of all CPUs.
+ */
+struct mymodule_stats {
+	/* Gauges go up and down; the copy of a single CPU may well be
+	 * negative, only the sum means something.
+	 */
+	s64 inflight;
+	/* Counters, cleared by a write to stats/reset. */
+	u64 reads;
+	u64 writes;
+	u64 errors;
+	u64 latency[HIST_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct mymodule_stats, stats);
+
+/* poll() watchers of the attributes are woken up at most once every
+ * notify_ms milliseconds, however often myvariable changes.
+ */
+static unsigned int notify_ms = 100;
+module_param(notify_ms, uint, 0644);
+MODULE_PARM_DESC(notify_ms, "Minimum interval between sysfs notifications.");
+
+static unsigned long notify_pending;
+
+static void metrics_refresh(void);
+
+static void notify_fn(struct work_struct *work)
+{
+	clear_bit(0, &notify_pending);
+	/* Mappings of the metrics file are only refreshed here. */
+	metrics_refresh();
+	sysfs_notify(mymodule, NULL, "metrics");
+	sysfs_notify(mymodule, NULL, "myvariable");
+	sysfs_notify(mymodule, "stats", "writes");
+	sysfs_notify(mymodule, "stats", "latency_histogram");
+}
+
+static DECLARE_DELAYED_WORK(notify_work, notify_fn);
+
+static void schedule_notify(void)
+{
+	/* Test first, so that the common case is a plain read. */
+	if (!test_bit(0, &notify_pending) &&
+	    !test_and_set_bit(0, &notify_pending))
+		schedule_delayed_work(&notify_work,
+				      msecs_to_jiffies(READ_ONCE(notify_ms)));
+}
+
+static void record_latency(u64 ns)
+{
+	unsigned int bucket = ns ? min(ilog2(ns), HIST_BUCKETS - 1) : 0;
+
+	this_cpu_inc(stats.latency[bucket]);
+}
+
 static ssize_t myvariable_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%d\n", myvariable);
+	this_cpu_inc(stats.reads);
+	return sprintf(buf, "%d\n", READ_ONCE(myvariable));
 }
 
 static ssize_t myvariable_store(struct kobject *kobj,
-				struct kobj_attribute *attr, char *buf,
+				struct kobj_attribute *attr, const char *buf,
 				size_t count)
 {
-	sscanf(buf, "%d", &myvariable);
-	return count;
+	u64 start = ktime_get_ns();
+	int value;
+	ssize_t ret = count;
+
+	this_cpu_inc(stats.inflight);
+	if (kstrtoint(buf, 0, &value)) {
+		this_cpu_inc(stats.errors);
+		ret = -EINVAL;
+	} else {
+		WRITE_ONCE(myvariable, value);
+		this_cpu_inc(stats.writes);
+		schedule_notify();
+	}
+	record_latency(ktime_get_ns() - start);
+	this_cpu_dec(stats.inflight);
+
+	return ret;
 }
 
 /* an attribute is a variable (in this case myvariable) with a mode
@@ -53,7 +161,168 @@ static ssize_t myvariable_store(struct kobject *kobj,
  *     }
  */
 static struct kobj_attribute myvariable_attribute =
-	__ATTR(myvariable, 0660, myvariable_show, (void *)myvariable_store);
+	__ATTR(myvariable, 0660, myvariable_show, myvariable_store);
+
+/* A read-only attribute showing one field of struct mymodule_stats,
+ * summed over all CPUs. The field is found by its offset, so that all
+ * of them share stat_show().
+ */
+struct stat_attribute {
+	struct kobj_attribute kattr;
+	size_t offset;
+};
+
+/* Sum the 64-bit field at @offset of struct mymodule_stats. */
+static s64 stat_sum(size_t offset)
+{
+	s64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(s64 *)((char *)per_cpu_ptr(&stats, cpu) + offset);
+	return sum;
+}
+
+static ssize_t stat_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	struct stat_attribute *sattr =
+		container_of(attr, struct stat_attribute, kattr);
+
+	return sprintf(buf, "%lld\n", stat_sum(sattr->offset));
+}
+
+#define LATENCY_OFFSET(i)                               \
+	(offsetof(struct mymodule_stats, latency) + \
+	 (i) * sizeof(u64))
+
+#define STAT_ATTR(_name)                                               \
+	static struct stat_attribute stat_attr_##_name = {             \
+		.kattr = __ATTR(_name, 0444, stat_show, NULL),         \
+		.offset = offsetof(struct mymodule_stats, _name),      \
+	}
+
+STAT_ATTR(inflight);
+STAT_ATTR(reads);
+STAT_ATTR(writes);
+STAT_ATTR(errors);
+
+/* One "<lower bound in ns> <count>" line per bucket. */
+static ssize_t latency_histogram_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		len += sprintf(buf + len, "%llu %llu\n", i ? 1ULL << i : 0,
+			       (u64)stat_sum(LATENCY_OFFSET(i)));
+	return len;
+}
+
+static struct kobj_attribute latency_histogram_attribute =
+	__ATTR_RO(latency_histogram);
+
+/* Clear the counters of every CPU; the gauges are left alone. An update
+ * racing with the reset may survive it.
+ */
+static ssize_t reset_store(struct kobject *kobj, struct kobj_attribute *attr,
+			   const char *buf, size_t count)
+{
+	const size_t start = offsetof(struct mymodule_stats, reads);
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset((char *)per_cpu_ptr(&stats, cpu) + start, 0,
+		       sizeof(struct mymodule_stats) - start);
+	schedule_notify();
+	return count;
+}
+
+static struct kobj_attribute reset_attribute = __ATTR_WO(reset);
+
+static struct attribute *stats_attrs[] = {
+	&stat_attr_inflight.kattr.attr,
+	&stat_attr_reads.kattr.attr,
+	&stat_attr_writes.kattr.attr,
+	&stat_attr_errors.kattr.attr,
+	&latency_histogram_attribute.attr,
+	&reset_attribute.attr,
+	NULL,
+};
+
+/* A named group becomes a subdirectory of the kobject. */
+static const struct attribute_group stats_group = {
+	.name = "stats",
+	.attrs = stats_attrs,
+};
+
+/* The blob behind the metrics file. It gets a page of its own, so that
+ * it can be mapped into userspace.
+ */
+static struct mymodule_metrics *metrics;
+static DEFINE_SPINLOCK(metrics_lock);
+
+/* Take a new snapshot into *metrics. seq is odd while the snapshot is
+ * being written, so lockless readers of a mapping can tell a torn copy.
+ */
+static void metrics_refresh(void)
+{
+	int i;
+
+	spin_lock(&metrics_lock);
+	WRITE_ONCE(metrics->seq, metrics->seq + 1);
+	smp_wmb();
+	metrics->myvariable = READ_ONCE(myvariable);
+	metrics->inflight = stat_sum(offsetof(struct mymodule_stats, inflight));
+	metrics->reads = stat_sum(offsetof(struct mymodule_stats, reads));
+	metrics->writes = stat_sum(offsetof(struct mymodule_stats, writes));
+	metrics->errors = stat_sum(offsetof(struct mymodule_stats, errors));
+	for (i = 0; i < HIST_BUCKETS; i++)
+		metrics->latency[i] = stat_sum(LATENCY_OFFSET(i));
+	smp_wmb();
+	WRITE_ONCE(metrics->seq, metrics->seq + 1);
+	spin_unlock(&metrics_lock);
+}
+
+/* Note that, unlike show(), a bin_attribute read() may be called with
+ * any offset and count; sysfs has already clamped them to attr->size.
+ */
+static ssize_t metrics_read(struct file *file, struct kobject *kobj,
+			    BIN_ATTR_CONST struct bin_attribute *attr,
+			    char *buf, loff_t off, size_t count)
+{
+	metrics_refresh();
+	spin_lock(&metrics_lock);
+	memcpy(buf, (char *)metrics + off, count);
+	spin_unlock(&metrics_lock);
+	return count;
+}
+
+static int metrics_mmap(struct file *file, struct kobject *kobj,
+			BIN_ATTR_CONST struct bin_attribute *attr,
+			struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(metrics) >> PAGE_SHIFT, PAGE_SIZE,
+			       vma->vm_page_prot);
+}
+
+static struct bin_attribute metrics_attribute = {
+	.attr = { .name = "metrics", .mode = 0444 },
+	.size = sizeof(struct mymodule_metrics),
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0) && \
+	LINUX_VERSION_CODE < KERNEL_VERSION(6, 17, 0)
+	.read_new = metrics_read,
+#else
+	.read = metrics_read,
+#endif
+	.mmap = metrics_mmap,
+};
 
 static int __init mymodule_init(void)
 {
@@ -61,6 +330,12 @@ static int __init mymodule_init(void)
 
 	pr_info("mymodule: initialised\n");
 
+	metrics = (struct mymodule_metrics *)get_zeroed_page(GFP_KERNEL);
+	if (!metrics)
+		return -ENOMEM;
+	metrics->version = MYMODULE_METRICS_VERSION;
+	metrics->size = sizeof(struct mymodule_metrics);
+
         /* Equivalent to:
          *     kobj = kobject_create();
          *     kobject_add(kobj, parent, "%s", name);
@@ -68,8 +343,10 @@ static int __init mymodule_init(void)
          * Assigning @kernel_kobj as parent makes it lie under /sys/kernel.
          */
 	mymodule = kobject_create_and_add("mymodule", kernel_kobj);
-	if (!mymodule)
+	if (!mymodule) {
+		free_page((unsigned long)metrics);
 		return -ENOMEM;
+	}
 
         /* Equivalent to:
          *     sysfs_create_file_ns(kobj, attr, NULL);
@@ -83,17 +360,50 @@ static int __init mymodule_init(void)
 	if (error) {
 		pr_info("failed to create the myvariable file "
 			"in /sys/kernel/mymodule\n");
+		goto out;
+	}
+
+	error = sysfs_create_group(mymodule, &stats_group);
+	if (error) {
+		pr_info("failed to create the stats group "
+			"in /sys/kernel/mymodule\n");
+		goto out_file;
 	}
 
+	error = sysfs_create_bin_file(mymodule, &metrics_attribute);
+	if (error) {
+		pr_info("failed to create the metrics file "
+			"in /sys/kernel/mymodule\n");
+		sysfs_remove_group(mymodule, &stats_group);
+		goto out_file;
+	}
+	return 0;
+
+out_file:
+	sysfs_remove_file(mymodule, &myvariable_attribute.attr);
+out:
+	kobject_put(mymodule);
+	free_page((unsigned long)metrics);
 	return error;
 }
 
 static void __exit mymodule_exit(void)
 {
 	pr_info("mymodule: Exit success\n");
+	/* Removing the files waits for running show()/store() calls, so
+	 * no notification can be scheduled after the cancel below.
+	 */
+	sysfs_remove_bin_file(mymodule, &metrics_attribute);
+	sysfs_remove_group(mymodule, &stats_group);
+	sysfs_remove_file(mymodule, &myvariable_attribute.attr);
+	cancel_delayed_work_sync(&notify_work);
         /* Decrease the reference counter of the kobject; since we're
            the sole owner, this frees the object. */
 	kobject_put(mymodule);
+	/* Removing the metrics file has also zapped its mappings, so the
+	 * page is no longer visible to userspace.
+	 */
+	free_page((unsigned long)metrics);
 }
 
 module_init(mymodule_init);
@@ -0,0 +1,40 @@
+/* \file mymodule.h
+ *
+ * Layout of /sys/kernel/mymodule/metrics.
+ *
+ * The definitions here have to be in a header file, because they need
+ * to be known both to the kernel module (in hello-sysfs.c) and the
+ * processes reading the file (in userspace/bench.c).
+ */
+
+#ifndef MYMODULE_H_
+#define MYMODULE_H_
+
+#include <linux/types.h>
+
+/* Number of buckets of the log2 latency histogram. */
+#define MYMODULE_HIST_BUCKETS 32
+/* Bumped whenever struct mymodule_metrics changes. */
+#define MYMODULE_METRICS_VERSION 1
+
+/* Every metric of the module, packed into one blob.
+ *
+ * A read() of the file takes a fresh snapshot. A mapping of the file is
+ * only refreshed when the module notifies pollers, at most once every
+ * notify_ms milliseconds. seq is odd while a snapshot is being written;
+ * readers of a mapping copy the blob and retry until seq was even and
+ * unchanged across the copy.
+ */
+struct mymodule_metrics {
+	__u32 version;
+	__u32 size;
+	__u64 seq;
+	__s64 myvariable;
+	__s64 inflight;
+	__u64 reads;
+	__u64 writes;
+	__u64 errors;
+	__u64 latency[MYMODULE_HIST_BUCKETS];
+};
+
+#endif /* MYMODULE_H_ */
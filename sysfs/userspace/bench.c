@@ -0,0 +1,141 @@
+/*  bench.c - compare ways of collecting the metrics of hello-sysfs
+ *
+ *  Takes the same snapshot of every metric in three ways and prints the
+ *  average cost of one snapshot:
+ *
+ *  - text: open/read/close every text attribute, as a collector
+ *    scraping sysfs would;
+ *  - read: open/read/close /sys/kernel/mymodule/metrics once;
+ *  - mmap: copy the blob out of a mapping of the metrics file.
+ *
+ *  Usage: ./bench [iterations]
+ */
+
+#include <mymodule.h>
+
+#include <fcntl.h> /* open */
+#include <stdio.h> /* standard I/O */
+#include <stdlib.h> /* exit, strtol */
+#include <string.h> /* memcpy */
+#include <sys/mman.h> /* mmap */
+#include <time.h> /* clock_gettime */
+#include <unistd.h> /* read, close */
+
+#define SYSFS_DIR "/sys/kernel/mymodule"
+
+static const char *const text_attrs[] = {
+	SYSFS_DIR "/myvariable",
+	SYSFS_DIR "/stats/inflight",
+	SYSFS_DIR "/stats/reads",
+	SYSFS_DIR "/stats/writes",
+	SYSFS_DIR "/stats/errors",
+	SYSFS_DIR "/stats/latency_histogram",
+};
+
+#define NR_TEXT_ATTRS (sizeof(text_attrs) / sizeof(text_attrs[0]))
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int read_file(const char *path, void *buf, size_t len)
+{
+	int fd = open(path, O_RDONLY);
+	ssize_t n;
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	n = read(fd, buf, len);
+	close(fd);
+	return n < 0 ? -1 : 0;
+}
+
+static int snapshot_text(void)
+{
+	char buf[4096];
+	size_t i;
+
+	for (i = 0; i < NR_TEXT_ATTRS; i++)
+		if (read_file(text_attrs[i], buf, sizeof(buf)))
+			return -1;
+	return 0;
+}
+
+static int snapshot_read(void)
+{
+	struct mymodule_metrics m;
+
+	return read_file(SYSFS_DIR "/metrics", &m, sizeof(m));
+}
+
+static const volatile struct mymodule_metrics *mapping;
+
+static int snapshot_mmap(void)
+{
+	struct mymodule_metrics m;
+	__u64 seq;
+
+	do {
+		seq = mapping->seq;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		memcpy(&m, (const void *)mapping, sizeof(m));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != mapping->seq);
+	return 0;
+}
+
+static void run(const char *name, int (*snapshot)(void), long iterations)
+{
+	long long start = now_ns();
+	long i;
+
+	for (i = 0; i < iterations; i++) {
+		if (snapshot()) {
+			printf("%s: failed\n", name);
+			exit(EXIT_FAILURE);
+		}
+	}
+	printf("%s: %lld ns/snapshot\n", name,
+	       (now_ns() - start) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations = argc > 1 ? strtol(argv[1], NULL, 0) : 10000;
+	int fd;
+
+	if (iterations <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	fd = open(SYSFS_DIR "/metrics", O_RDONLY);
+	if (fd < 0) {
+		perror(SYSFS_DIR "/metrics");
+		exit(EXIT_FAILURE);
+	}
+	mapping = mmap(NULL, sizeof(struct mymodule_metrics), PROT_READ,
+		       MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	if (mapping->version != MYMODULE_METRICS_VERSION) {
+		fprintf(stderr, "unknown metrics version %u\n",
+			mapping->version);
+		exit(EXIT_FAILURE);
+	}
+
+	run("text", snapshot_text, iterations);
+	run("read", snapshot_read, iterations);
+	run("mmap", snapshot_mmap, iterations);
+
+	return 0;
+}